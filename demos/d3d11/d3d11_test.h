@@ -48,7 +48,7 @@ struct D3D11GraphicsTest : public GraphicsTest
 
   bool Init(int argc, char **argv);
   GraphicsWindow *MakeWindow(int width, int height, const char *title);
-  bool IsSupported();
+  static bool IsSupported();
 
   void PostDeviceCreate();
 
@@ -49,7 +49,7 @@ struct D3D12GraphicsTest : public GraphicsTest
 
   bool Init(int argc, char **argv);
   GraphicsWindow *MakeWindow(int width, int height, const char *title);
-  bool IsSupported();
+  static bool IsSupported();
 
   enum BufType
   {
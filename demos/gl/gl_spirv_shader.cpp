@@ -87,7 +87,7 @@ void main()
     if(!Init(argc, argv))
       return 3;
 
-    if(!SpvCompilationSupported())
+    if(!SpvCompilationSupported() && !HavePrecompiledSpv())
     {
       TEST_ERROR("Can't run SPIR-V test without glslc in PATH");
       return 2;
@@ -147,10 +147,13 @@ void main()
       GLuint vs = glCreateShader(GL_VERTEX_SHADER);
       GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
 
-      std::vector<uint32_t> vsSPIRV =
-          CompileShaderToSpv(vertex, ShaderLang::glsl, ShaderStage::vert, "main");
-      std::vector<uint32_t> fsSPIRV =
-          CompileShaderToSpv(pixel, ShaderLang::glsl, ShaderStage::frag, "main");
+      std::vector<std::vector<uint32_t>> spirv = CompileShadersToSpv({
+          {vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+          {pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+      });
+
+      const std::vector<uint32_t> &vsSPIRV = spirv[0];
+      const std::vector<uint32_t> &fsSPIRV = spirv[1];
 
       glShaderBinary(1, &vs, GL_SHADER_BINARY_FORMAT_SPIR_V, vsSPIRV.data(),
                      (GLsizei)vsSPIRV.size() * 4);
@@ -46,6 +46,13 @@ void OpenGLGraphicsTest::PostInit()
 
 OpenGLGraphicsTest::~OpenGLGraphicsTest()
 {
+  if(!readbacks.empty() || !freeReadbackPBOs.empty())
+  {
+    FinishReadbacks(true);
+
+    glDeleteBuffers((GLsizei)freeReadbackPBOs.size(), freeReadbackPBOs.data());
+  }
+
   if(!managedResources.bufs.empty())
     glDeleteBuffers((GLsizei)managedResources.bufs.size(), &managedResources.bufs[0]);
   if(!managedResources.texs.empty())
@@ -66,6 +73,8 @@ OpenGLGraphicsTest::~OpenGLGraphicsTest()
 
 GLuint OpenGLGraphicsTest::MakeProgram(std::string vertSrc, std::string fragSrc, bool sep)
 {
+  PROFILE_ZONE("MakeProgram");
+
   GLuint vs = vertSrc.empty() ? 0 : glCreateShader(GL_VERTEX_SHADER);
   GLuint fs = fragSrc.empty() ? 0 : glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -215,4 +224,111 @@ bool OpenGLGraphicsTest::Running()
     return false;
 
   return mainWindow->Update();
-}
\ No newline at end of file
+}
+
+void OpenGLGraphicsTest::ReadbackBackbuffer(ReadbackCallback callback)
+{
+  pendingReadback = callback;
+}
+
+void OpenGLGraphicsTest::UpdateReadbacks()
+{
+  if(curFrame == dumpFrame && !dumpFramePath.empty())
+  {
+    std::string path = dumpFramePath;
+    ReadbackBackbuffer([path](uint32_t width, uint32_t height, std::vector<byte> &rgba) {
+      WritePNGAsync(path, width, height, std::move(rgba));
+    });
+  }
+
+  if(pendingReadback)
+  {
+    PendingReadback readback;
+    readback.width = (uint32_t)screenWidth;
+    readback.height = (uint32_t)screenHeight;
+    readback.callback = pendingReadback;
+    pendingReadback = nullptr;
+
+    if(freeReadbackPBOs.empty())
+    {
+      glGenBuffers(1, &readback.pbo);
+    }
+    else
+    {
+      readback.pbo = freeReadbackPBOs.back();
+      freeReadbackPBOs.pop_back();
+    }
+
+    // don't disturb whatever state the test has bound
+    GLint prevPack = 0, prevRead = 0, prevAlign = 4;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prevPack);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevRead);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &prevAlign);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, readback.width * readback.height * 4, NULL, GL_STREAM_READ);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // this only queues the copy into the buffer, it doesn't wait for it
+    glReadPixels(0, 0, readback.width, readback.height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, prevPack);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, prevRead);
+    glPixelStorei(GL_PACK_ALIGNMENT, prevAlign);
+
+    readbacks.push_back(readback);
+  }
+
+  FinishReadbacks(false);
+}
+
+void OpenGLGraphicsTest::FinishReadbacks(bool wait)
+{
+  while(!readbacks.empty())
+  {
+    PendingReadback readback = readbacks.front();
+
+    GLenum status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     wait ? 10000000000ULL : 0);
+
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED && !wait)
+      break;
+
+    readbacks.pop_front();
+
+    glDeleteSync(readback.fence);
+
+    GLint prevPack = 0;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prevPack);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+
+    const size_t rowSize = size_t(readback.width) * 4;
+    const byte *data = (const byte *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                      rowSize * readback.height, GL_MAP_READ_BIT);
+
+    std::vector<byte> rgba(rowSize * readback.height);
+
+    // GL's rows start at the bottom
+    if(data)
+    {
+      for(uint32_t y = 0; y < readback.height; y++)
+        memcpy(&rgba[y * rowSize], data + (readback.height - 1 - y) * rowSize, rowSize);
+
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, prevPack);
+
+    freeReadbackPBOs.push_back(readback.pbo);
+
+    if(data)
+      readback.callback(readback.width, readback.height, rgba);
+    else
+      TEST_WARN("Couldn't map backbuffer readback");
+  }
+}
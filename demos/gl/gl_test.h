@@ -28,6 +28,7 @@
 
 #include "3rdparty/glad/glad.h"
 
+#include <deque>
 #include <vector>
 
 struct OpenGLGraphicsTest : public GraphicsTest
@@ -37,7 +38,7 @@ struct OpenGLGraphicsTest : public GraphicsTest
   ~OpenGLGraphicsTest();
 
   bool Init(int argc, char **argv);
-  bool IsSupported();
+  static bool IsSupported();
   GraphicsWindow *MakeWindow(int width, int height, const char *title);
   void *MakeContext(GraphicsWindow *win, void *share);
   void DestroyContext(void *ctx);
@@ -56,6 +57,13 @@ struct OpenGLGraphicsTest : public GraphicsTest
   bool Running();
   void Present(GraphicsWindow *window);
   void Present() { Present(mainWindow); }
+
+  // read the main window's backbuffer back into a pixel buffer when it's next presented, without
+  // waiting for it. The callback is run once the copy has completed, normally in a later Present()
+  void ReadbackBackbuffer(ReadbackCallback callback);
+  void UpdateReadbacks();
+  void FinishReadbacks(bool wait);
+
   int glMajor = 4;
   int glMinor = 3;
   bool coreProfile = true;
@@ -69,4 +77,17 @@ struct OpenGLGraphicsTest : public GraphicsTest
   {
     std::vector<GLuint> bufs, texs, progs, pipes, vaos, fbos;
   } managedResources;
+
+  struct PendingReadback
+  {
+    GLuint pbo;
+    GLsync fence;
+    uint32_t width, height;
+    ReadbackCallback callback;
+  };
+
+  // readbacks complete in the order they were issued
+  std::deque<PendingReadback> readbacks;
+  std::vector<GLuint> freeReadbackPBOs;
+  ReadbackCallback pendingReadback;
 };
\ No newline at end of file
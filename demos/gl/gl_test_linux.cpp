@@ -29,20 +29,154 @@
 
 #include "../linux/linux_window.h"
 
+#ifndef HAVE_EGL
+#define HAVE_EGL 0
+#endif
+
+#if HAVE_EGL
+
+#include "3rdparty/glad/glad_egl.h"
+
+// when running headless there's no window system at all, and each 'window' is a pbuffer surface
+// on an EGL display - preferably the surfaceless platform so that no X server is needed.
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLConfig eglConfig = NULL;
+static bool eglSRGB = false;
+
+struct EGLPbufferWindow : public GraphicsWindow
+{
+  EGLPbufferWindow(int width, int height)
+  {
+    EGLint attribs[] = {
+        EGL_WIDTH, width, EGL_HEIGHT, height, EGL_GL_COLORSPACE, EGL_GL_COLORSPACE_SRGB, EGL_NONE,
+    };
+
+    // drop the colorspace attribute if sRGB surfaces aren't supported
+    if(!eglSRGB)
+      attribs[4] = EGL_NONE;
+
+    surface = eglCreatePbufferSurface(eglDisplay, eglConfig, attribs);
+
+    // the config may not be sRGB capable even if the display is, so retry without it
+    if(surface == EGL_NO_SURFACE && attribs[4] != EGL_NONE)
+    {
+      attribs[4] = EGL_NONE;
+      surface = eglCreatePbufferSurface(eglDisplay, eglConfig, attribs);
+    }
+  }
+  ~EGLPbufferWindow()
+  {
+    if(surface != EGL_NO_SURFACE)
+      eglDestroySurface(eglDisplay, surface);
+  }
+  void Resize(int width, int height) {}
+  bool Update() { return true; }
+  EGLSurface surface;
+};
+
+static bool InitEGLDisplay(bool gles, int glMajor)
+{
+  if(eglDisplay != EGL_NO_DISPLAY)
+    return true;
+
+  gladLoadEGL();
+
+  const char *clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+  if(clientExts && strstr(clientExts, "EGL_MESA_platform_surfaceless") &&
+     eglGetPlatformDisplayEXT)
+    eglDisplay = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+  if(eglDisplay == EGL_NO_DISPLAY)
+  {
+    TEST_WARN("EGL_MESA_platform_surfaceless not available, falling back to default display");
+    eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLint major = 0, minor = 0;
+  if(eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+  {
+    TEST_ERROR("Couldn't initialise EGL display");
+    eglDisplay = EGL_NO_DISPLAY;
+    return false;
+  }
+
+  const char *dpyExts = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+
+  eglSRGB = (major > 1 || minor >= 5) ||
+            (dpyExts && strstr(dpyExts, "EGL_KHR_gl_colorspace") != NULL);
+
+  if(!eglBindAPI(gles ? EGL_OPENGL_ES_API : EGL_OPENGL_API))
+  {
+    TEST_ERROR("Couldn't bind %s API on EGL display", gles ? "OpenGL ES" : "OpenGL");
+    return false;
+  }
+
+  EGLint renderable = EGL_OPENGL_BIT;
+  if(gles)
+    renderable = glMajor >= 3 ? EGL_OPENGL_ES3_BIT : EGL_OPENGL_ES2_BIT;
+
+  EGLint cfgAttribs[] = {
+      EGL_SURFACE_TYPE,
+      EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE,
+      renderable,
+      EGL_RED_SIZE,
+      8,
+      EGL_GREEN_SIZE,
+      8,
+      EGL_BLUE_SIZE,
+      8,
+      EGL_NONE,
+  };
+
+  EGLint numCfgs = 0;
+  if(!eglChooseConfig(eglDisplay, cfgAttribs, &eglConfig, 1, &numCfgs) || numCfgs == 0)
+  {
+    TEST_ERROR("Couldn't choose EGL pbuffer config");
+    return false;
+  }
+
+  return true;
+}
+
+#endif
+
 bool OpenGLGraphicsTest::Init(int argc, char **argv)
 {
+  PROFILE_ZONE("OpenGLGraphicsTest::Init");
+
   // parse parameters here to override parameters
   GraphicsTest::Init(argc, argv);
 
-  X11Window::Init();
+  if(headless)
+  {
+#if HAVE_EGL
+    PROFILE_ZONE("InitEGLDisplay");
 
-  Display *dpy = X11Window::GetDisplay();
+    if(!InitEGLDisplay(gles, glMajor))
+      return false;
+#else
+    TEST_ERROR("Headless OpenGL requires the demos to be built with EGL");
+    return false;
+#endif
+  }
+  else
+  {
+    X11Window::Init();
 
-  gladLoadGLX(dpy, DefaultScreen(dpy));
+    Display *dpy = X11Window::GetDisplay();
 
-  mainWindow = new X11Window(screenWidth, screenHeight, screenTitle);
+    gladLoadGLX(dpy, DefaultScreen(dpy));
+  }
 
-  mainContext = MakeContext(mainWindow, NULL);
+  mainWindow = MakeWindow(screenWidth, screenHeight, screenTitle);
+
+  {
+    PROFILE_ZONE("MakeContext");
+
+    mainContext = MakeContext(mainWindow, NULL);
+  }
 
   if(!mainWindow || !mainContext)
   {
@@ -53,7 +187,16 @@ bool OpenGLGraphicsTest::Init(int argc, char **argv)
 
   ActivateContext(mainWindow, mainContext);
 
-  if(!gladLoadGL())
+  int loaded = 0;
+
+#if HAVE_EGL
+  if(headless)
+    loaded = gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+  else
+#endif
+    loaded = gladLoadGL();
+
+  if(!loaded)
   {
     delete mainWindow;
     TEST_ERROR("Error initialising glad");
@@ -84,11 +227,60 @@ bool OpenGLGraphicsTest::IsSupported()
 
 GraphicsWindow *OpenGLGraphicsTest::MakeWindow(int width, int height, const char *title)
 {
+#if HAVE_EGL
+  if(headless)
+  {
+    EGLPbufferWindow *win = new EGLPbufferWindow(width, height);
+
+    if(win->surface == EGL_NO_SURFACE)
+    {
+      TEST_ERROR("Couldn't create EGL pbuffer surface: %x", eglGetError());
+      delete win;
+      return NULL;
+    }
+
+    return win;
+  }
+#endif
+
   return new X11Window(width, height, title);
 }
 
 void *OpenGLGraphicsTest::MakeContext(GraphicsWindow *win, void *share)
 {
+#if HAVE_EGL
+  if(headless)
+  {
+    EGLint attribs[64] = {0};
+    int i = 0;
+
+    attribs[i++] = EGL_CONTEXT_MAJOR_VERSION;
+    attribs[i++] = glMajor;
+    attribs[i++] = EGL_CONTEXT_MINOR_VERSION;
+    attribs[i++] = glMinor;
+    if(debugDevice)
+    {
+      attribs[i++] = EGL_CONTEXT_OPENGL_DEBUG;
+      attribs[i++] = EGL_TRUE;
+    }
+    if(!gles)
+    {
+      attribs[i++] = EGL_CONTEXT_OPENGL_PROFILE_MASK;
+      attribs[i++] = coreProfile ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT
+                                 : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT;
+    }
+    attribs[i++] = EGL_NONE;
+
+    EGLContext ctx = eglCreateContext(eglDisplay, eglConfig,
+                                      share ? (EGLContext)share : EGL_NO_CONTEXT, attribs);
+
+    if(ctx == EGL_NO_CONTEXT)
+      return NULL;
+
+    return ctx;
+  }
+#endif
+
   if(!GLAD_GLX_ARB_create_context_profile)
   {
     TEST_ERROR("Need GLX_ARB_create_context_profile to initialise");
@@ -193,6 +385,14 @@ void OpenGLGraphicsTest::DestroyContext(void *ctx)
   if(ctx == NULL)
     return;
 
+#if HAVE_EGL
+  if(headless)
+  {
+    eglDestroyContext(eglDisplay, (EGLContext)ctx);
+    return;
+  }
+#endif
+
   X11Window *x11win = (X11Window *)mainWindow;
 
   // we assume the display pointer is shared among all windows
@@ -201,6 +401,16 @@ void OpenGLGraphicsTest::DestroyContext(void *ctx)
 
 void OpenGLGraphicsTest::ActivateContext(GraphicsWindow *win, void *ctx)
 {
+#if HAVE_EGL
+  if(headless)
+  {
+    EGLSurface surface = win ? ((EGLPbufferWindow *)win)->surface : EGL_NO_SURFACE;
+
+    eglMakeCurrent(eglDisplay, surface, surface, ctx ? (EGLContext)ctx : EGL_NO_CONTEXT);
+    return;
+  }
+#endif
+
   X11Window *x11win = (X11Window *)win;
 
   glXMakeContextCurrent(x11win->xlib.display, x11win->xlib.window, x11win->xlib.window,
@@ -209,6 +419,17 @@ void OpenGLGraphicsTest::ActivateContext(GraphicsWindow *win, void *ctx)
 
 void OpenGLGraphicsTest::Present(GraphicsWindow *window)
 {
+  if(window == mainWindow)
+    UpdateReadbacks();
+
+#if HAVE_EGL
+  if(headless)
+  {
+    eglSwapBuffers(eglDisplay, ((EGLPbufferWindow *)window)->surface);
+    return;
+  }
+#endif
+
   X11Window *x11win = (X11Window *)window;
 
   glXSwapBuffers(x11win->xlib.display, x11win->xlib.window);
@@ -34,6 +34,8 @@ typedef BOOL(WINAPI *PFN_wglDeleteContext)(HGLRC);
 
 bool OpenGLGraphicsTest::Init(int argc, char **argv)
 {
+  PROFILE_ZONE("OpenGLGraphicsTest::Init");
+
   // parse parameters here to override parameters
   GraphicsTest::Init(argc, argv);
 
@@ -87,7 +89,11 @@ bool OpenGLGraphicsTest::Init(int argc, char **argv)
   ReleaseDC(win32win->wnd, dc);
   deleteContext(rc);
 
-  mainContext = MakeContext(mainWindow, NULL);
+  {
+    PROFILE_ZONE("MakeContext");
+
+    mainContext = MakeContext(mainWindow, NULL);
+  }
 
   if(!mainWindow || !mainContext)
   {
@@ -277,6 +283,9 @@ void OpenGLGraphicsTest::ActivateContext(GraphicsWindow *win, void *ctx)
 
 void OpenGLGraphicsTest::Present(GraphicsWindow *window)
 {
+  if(window == mainWindow)
+    UpdateReadbacks();
+
   Win32Window *win32win = (Win32Window *)window;
 
   HDC dc = GetDC(win32win->wnd);
@@ -23,6 +23,10 @@
 ******************************************************************************/
 
 #include "test_common.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 
 std::string GetCWD()
 {
@@ -40,3 +44,97 @@ std::string GetCWD()
 
   return cwdstr;
 }
+
+std::string GetDefaultCacheDir()
+{
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  if(xdg && xdg[0])
+    return std::string(xdg) + "/renderdoc_demos";
+
+  const char *home = getenv("HOME");
+  if(home && home[0])
+    return std::string(home) + "/.cache/renderdoc_demos";
+
+  return "/tmp/renderdoc_demos";
+}
+
+bool MakeDir(const std::string &path)
+{
+  // create each parent in turn, ignoring any that already exist
+  for(size_t i = 1; i <= path.size(); i++)
+  {
+    if(i == path.size() || path[i] == '/')
+    {
+      std::string sub = path.substr(0, i);
+      if(mkdir(sub.c_str(), 0775) != 0 && errno != EEXIST)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+std::string FindInPath(const std::string &exe)
+{
+  const char *pathEnv = getenv("PATH");
+
+  if(exe.find('/') != std::string::npos || !pathEnv)
+    return access(exe.c_str(), X_OK) == 0 ? exe : "";
+
+  std::string paths = pathEnv;
+
+  size_t start = 0;
+  while(start <= paths.size())
+  {
+    size_t end = paths.find(':', start);
+    if(end == std::string::npos)
+      end = paths.size();
+
+    std::string dir = paths.substr(start, end - start);
+    if(dir.empty())
+      dir = ".";
+
+    std::string candidate = dir + "/" + exe;
+    if(access(candidate.c_str(), X_OK) == 0)
+      return candidate;
+
+    start = end + 1;
+  }
+
+  return "";
+}
+
+bool GetFileStamp(const std::string &path, uint64_t &size, uint64_t &modified)
+{
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0)
+    return false;
+
+  size = (uint64_t)st.st_size;
+  modified = (uint64_t)st.st_mtime;
+  return true;
+}
+
+std::string GetModulePath(const void *address)
+{
+  Dl_info info = {};
+  if(dladdr(address, &info) == 0 || !info.dli_fname)
+    return "";
+
+  return info.dli_fname;
+}
+
+std::string MakeTempFile()
+{
+  const char *tmpdir = getenv("TMPDIR");
+
+  std::string path = (tmpdir && tmpdir[0]) ? tmpdir : "/tmp";
+  path += "/rdoc_demos_XXXXXX";
+
+  int fd = mkstemp(&path[0]);
+  if(fd < 0)
+    return "";
+
+  close(fd);
+  return path;
+}
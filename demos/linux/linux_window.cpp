@@ -31,6 +31,10 @@ static xcb_intern_atom_reply_t *atom_wm_delete_window = NULL;
 
 void X11Window::Init()
 {
+  // several tests can run in one process, but they all share the same connection
+  if(display)
+    return;
+
   display = XOpenDisplay(NULL);
   connection = XGetXCBConnection(display);
 
@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <regex>
 #include <string>
 
 #include "test_common.h"
@@ -225,6 +226,162 @@ void RegisterTest(TestMetadata test)
   test_list().push_back(test);
 }
 
+// probing an API can mean loading its libraries, so each one is only probed once
+static bool IsAPISupported(const TestMetadata &test)
+{
+  enum
+  {
+    Unknown,
+    Supported,
+    Unsupported,
+  };
+
+  static int status[(int)TestAPI::Count] = {};
+
+  int &apiStatus = status[(int)test.API];
+
+  if(apiStatus == Unknown)
+    apiStatus = test.IsSupported() ? Supported : Unsupported;
+
+  return apiStatus == Supported;
+}
+
+static int RunTest(const TestMetadata &test, int argc, char **argv)
+{
+  TEST_LOG("\n\n======\nRunning %s\n\n", test.Name);
+
+  GraphicsTest *impl = test.Create();
+
+  int ret = 0;
+  {
+    PROFILE_ZONE("Test main");
+    ret = impl->main(argc, argv);
+  }
+  impl->ReportFrameTimes(test.QualifiedName());
+
+  delete impl;
+
+  // a dumped frame may still be being written
+  FinishAsyncWrites();
+
+  return ret;
+}
+
+// when running many tests, each writes its performance report next to the requested path with the
+// test's name added, e.g. perf.json becomes perf_VK_Simple_Triangle.json
+static std::string PerTestReportPath(const std::string &path, const char *testName)
+{
+  size_t sep = path.find_last_of("/\\");
+  size_t dot = path.find_last_of('.');
+
+  if(dot == std::string::npos || (sep != std::string::npos && dot < sep))
+    dot = path.size();
+
+  return path.substr(0, dot) + "_" + testName + path.substr(dot);
+}
+
+// run every test matching any of a comma-separated list of names or regexes, one after another in
+// this process. Tests hand their device over to the next one where they can
+static int RunManyTests(const std::vector<TestMetadata> &tests, const std::string &patterns,
+                        int argc, char **argv)
+{
+  std::vector<std::regex> regexes;
+
+  size_t start = 0;
+  while(start <= patterns.size())
+  {
+    size_t end = patterns.find(',', start);
+    if(end == std::string::npos)
+      end = patterns.size();
+
+    std::string pattern = trim(patterns.substr(start, end - start));
+    start = end + 1;
+
+    if(pattern.empty())
+      continue;
+
+    try
+    {
+      regexes.push_back(std::regex(pattern));
+    }
+    catch(const std::regex_error &)
+    {
+      TEST_ERROR("Invalid test pattern '%s'", pattern.c_str());
+      return 2;
+    }
+  }
+
+  struct TestResult
+  {
+    std::string name;
+    int ret;
+    double milliseconds;
+  };
+
+  std::vector<TestResult> results;
+
+  SetResourceSharing(true);
+
+  for(const TestMetadata &test : tests)
+  {
+    std::string qualified = test.QualifiedName();
+
+    bool match = false;
+    for(const std::regex &r : regexes)
+      match |= std::regex_match(test.Name, r) || std::regex_match(qualified, r);
+
+    if(!match)
+      continue;
+
+    if(!IsAPISupported(test))
+    {
+      TEST_WARN("Skipping %s, %s is not available", test.Name, test.APIName());
+      continue;
+    }
+
+    std::vector<std::string> args(argv, argv + argc);
+
+    for(size_t i = 0; i + 1 < args.size(); i++)
+      if(args[i] == "--perf-report")
+        args[i + 1] = PerTestReportPath(args[i + 1], test.Name);
+
+    std::vector<char *> testArgv;
+    for(std::string &arg : args)
+      testArgv.push_back(&arg[0]);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    int ret = RunTest(test, (int)testArgv.size(), testArgv.data());
+
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - begin;
+
+    results.push_back({qualified, ret, duration.count()});
+  }
+
+  ReleaseSharedResources();
+
+  if(results.empty())
+  {
+    TEST_ERROR("No tests matched '%s'", patterns.c_str());
+    return 2;
+  }
+
+  int failed = 0;
+
+  TEST_LOG("Ran %zu tests:", results.size());
+
+  for(const TestResult &result : results)
+  {
+    TEST_LOG("%-48s %-6s %10.2f ms", result.name.c_str(), result.ret == 0 ? "passed" : "failed",
+             result.milliseconds);
+
+    if(result.ret != 0)
+      failed++;
+  }
+
+  return failed > 0 ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
   std::vector<TestMetadata> &tests = test_list();
@@ -247,6 +404,39 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  // these apply before any test is created, since probing for API support can use the cache
+  for(int i = 0; i < argc; i++)
+  {
+    if(i + 1 < argc && !strcmp(argv[i], "--trace"))
+      EnableTrace(argv[i + 1]);
+
+    if(i + 1 < argc && !strcmp(argv[i], "--cache-dir"))
+      SetCacheDir(argv[i + 1]);
+
+    if(!strcmp(argv[i], "--no-capability-cache"))
+      SetCapabilityCacheEnabled(false);
+  }
+
+  // unlike --list this probes each API, so it only lists the tests that can run here
+  if(argc >= 2 && !strcmp(argv[1], "--list-supported"))
+  {
+    for(const TestMetadata &test : tests)
+    {
+      if(IsAPISupported(test))
+        printf("%s (%s) - %s\n", test.Name, test.APIName(), test.Description);
+    }
+
+    fflush(stdout);
+    return 1;
+  }
+
+  if(argc >= 3 && !strcmp(argv[1], "--run-many"))
+  {
+    int ret = RunManyTests(tests, argv[2], argc, argv);
+    WriteTrace();
+    return ret;
+  }
+
   std::string testchoice;
 
   if(argc >= 2)
@@ -255,6 +445,11 @@ int main(int argc, char **argv)
   }
   else
   {
+    // only offer tests that can run here
+    tests.erase(std::remove_if(tests.begin(), tests.end(),
+                               [](const TestMetadata &test) { return !IsAPISupported(test); }),
+                tests.end());
+
     const int width = 400, height = 575;
 
     nk_context *ctx = NuklearInit(width, height, "RenderDoc Test Program");
@@ -424,8 +619,15 @@ int main(int argc, char **argv)
   {
     if(testchoice == test.Name)
     {
-      TEST_LOG("\n\n======\nRunning %s\n\n", test.Name);
-      int ret = test.test->main(argc, argv);
+      if(!IsAPISupported(test))
+      {
+        TEST_ERROR("%s is not supported, %s is not available", test.Name, test.APIName());
+        return 2;
+      }
+
+      int ret = RunTest(test, argc, argv);
+
+      WriteTrace();
       return ret;
     }
   }
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Compiles the shaders embedded in demo sources to SPIR-V at build time, and writes out a source
+# file with the results so that CompileShaderToSpv can find them without running a compiler.
+#
+# Shader sources are found by looking for raw string literals assigned to variables, e.g.
+#   std::string pixel = R"EOSHADER( ... )EOSHADER";
+# and then looking for compile calls or batch jobs that concatenate those variables, e.g.
+#   CompileShaderModule(common + pixel, ShaderLang::glsl, ShaderStage::frag, "main")
+#   {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+# Any shader built from something other than plain literals is skipped and compiled at runtime.
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+literal_re = re.compile(r'std::string\s+(\w+)\s*=\s*R"EOSHADER\((.*?)\)EOSHADER";', re.DOTALL)
+job_re = re.compile(r'(?:CompileShaderModule\(|CompileShaderToSpv\(|\{)\s*([\w\s+]+?),\s*'
+                    r'ShaderLang::(\w+),\s*ShaderStage::(\w+),\s*"(\w+)"\s*[)}]')
+
+
+# must match HashBytes() in test_common.cpp
+def fnv1a(data: bytes, seed=0xcbf29ce484222325):
+    h = seed
+    for b in data:
+        h ^= b
+        h = (h * 0x100000001b3) & 0xffffffffffffffff
+    return h
+
+
+# must match the key in GetSpvKeyHash() in test_common.cpp
+def shader_key(source: str, lang: str, stage: str, entry: str):
+    return fnv1a('\0'.join([lang, stage, entry, source]).encode('utf-8'))
+
+
+def compile_shader(glslc, source, lang, stage, entry):
+    with tempfile.TemporaryDirectory() as tmp:
+        infile = os.path.join(tmp, 'shader')
+        outfile = os.path.join(tmp, 'shader.spv')
+
+        with open(infile, 'w', encoding='utf-8', newline='') as f:
+            f.write(source)
+
+        # the same options as CompileShaderToSpv uses
+        cmd = [glslc, '-g', '-O0', '-fentry-point=' + entry, '-x', lang, '-fshader-stage=' + stage,
+               '-o', outfile, infile]
+
+        if subprocess.call(cmd) != 0:
+            return None
+
+        with open(outfile, 'rb') as f:
+            spirv = f.read()
+
+    if len(spirv) % 4 != 0:
+        return None
+
+    return [int.from_bytes(spirv[i:i+4], 'little') for i in range(0, len(spirv), 4)]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--glslc', default='glslc', help="The glslc executable to compile with", type=str)
+    parser.add_argument('--output', required=True, help="The source file to write", type=str)
+    parser.add_argument('sources', nargs='+', help="The demo sources to scan for shaders", type=str)
+    args = parser.parse_args()
+
+    shaders = {}
+
+    for src in args.sources:
+        with open(src, 'r', encoding='utf-8', newline='') as f:
+            text = f.read()
+
+        literals = {m.group(1): m.group(2) for m in literal_re.finditer(text)}
+
+        for m in job_re.finditer(text):
+            names = [n.strip() for n in m.group(1).split('+')]
+
+            if not all(n in literals for n in names):
+                continue
+
+            source = ''.join(literals[n] for n in names)
+            lang, stage, entry = m.group(2), m.group(3), m.group(4)
+
+            key = shader_key(source, lang, stage, entry)
+
+            if key in shaders:
+                continue
+
+            spirv = compile_shader(args.glslc, source, lang, stage, entry)
+
+            if spirv is None:
+                print("{}: failed to compile {} {} shader '{}'".format(src, lang, stage, ' + '.join(names)))
+                sys.exit(1)
+
+            shaders[key] = spirv
+
+    # sorted so that lookups can binary search
+    keys = sorted(shaders.keys())
+
+    out = ['// generated by precompile_spirv.py - do not edit', '', '#include "test_common.h"', '']
+
+    for i, key in enumerate(keys):
+        out.append('static constexpr uint32_t spirv{}[] = {{'.format(i))
+        words = shaders[key]
+        for w in range(0, len(words), 8):
+            out.append('    ' + ' '.join('0x{:08x},'.format(x) for x in words[w:w+8]))
+        out.append('};')
+        out.append('')
+
+    out.append('extern const PrecompiledSpv precompiledSpv[] = {')
+    for i, key in enumerate(keys):
+        out.append('    {{0x{:016x}ULL, spirv{}, ARRAY_COUNT(spirv{})}},'.format(key, i, i))
+    # arrays can't be empty
+    if not keys:
+        out.append('    {0, NULL, 0},')
+    out.append('};')
+    out.append('')
+    out.append('extern const size_t precompiledSpvCount = {};'.format(len(keys)))
+    out.append('')
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out))
+
+    print("Precompiled {} shaders to SPIR-V".format(len(keys)))
+
+
+if __name__ == '__main__':
+    main()
@@ -25,6 +25,12 @@
 #include "test_common.h"
 #include <stdarg.h>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
 
 const DefaultA2V DefaultTri[3] = {
     {Vec3f(-0.5f, -0.5f, 0.0f), Vec4f(1.0f, 0.0f, 0.0f, 1.0f), Vec2f(0.0f, 0.0f)},
@@ -71,7 +77,424 @@ std::string trim(const std::string &str)
   return str.substr(start, end - start + 1);
 }
 
-static char printBuf[4096] = {};
+uint64_t HashBytes(const void *data, size_t len, uint64_t seed)
+{
+  // FNV-1a
+  const byte *bytes = (const byte *)data;
+  uint64_t hash = seed;
+  for(size_t i = 0; i < len; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint64_t HashString(const std::string &str, uint64_t seed)
+{
+  return HashBytes(str.c_str(), str.size(), seed);
+}
+
+static std::string cacheDir;
+
+void SetCacheDir(const std::string &dir)
+{
+  cacheDir = dir;
+}
+
+std::string GetCacheDir()
+{
+  if(cacheDir.empty())
+    cacheDir = GetDefaultCacheDir();
+
+  return cacheDir;
+}
+
+bool ReadFileData(const std::string &path, std::vector<byte> &data)
+{
+  data.clear();
+
+  FILE *f = fopen(path.c_str(), "rb");
+  if(!f)
+    return false;
+
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  bool ret = false;
+
+  if(len >= 0)
+  {
+    data.resize((size_t)len);
+    ret = len == 0 || fread(&data[0], 1, data.size(), f) == data.size();
+  }
+
+  fclose(f);
+
+  if(!ret)
+    data.clear();
+
+  return ret;
+}
+
+bool WriteFileAtomically(const std::string &path, const void *data, size_t size)
+{
+  // a bare filename goes in the current directory, which must already exist
+  size_t sep = path.find_last_of("/\\");
+  if(sep != std::string::npos && sep > 0)
+    MakeDir(path.substr(0, sep));
+
+  // write to a file unique to this process and thread and rename it into place, so concurrent
+  // writers never see a partially written file
+  std::string tmp = path + "." + std::to_string(getpid()) + "." +
+                    std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if(!f)
+    return false;
+
+  size_t written = fwrite(data, 1, size, f);
+  fclose(f);
+
+#if defined(WIN32)
+  // rename won't replace an existing file on windows
+  if(written == size)
+    unlink(path.c_str());
+#endif
+
+  if(written != size || rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+struct CachedCapability
+{
+  std::string identity;
+  std::string value;
+};
+
+static std::mutex capabilityLock;
+static bool capabilityCacheEnabled = true;
+
+static std::string GetCapabilityCachePath()
+{
+  return GetCacheDir() + "/capabilities.txt";
+}
+
+// one entry per line, as key, identity and value separated by tabs
+static std::map<std::string, CachedCapability> ReadCapabilities()
+{
+  std::map<std::string, CachedCapability> ret;
+
+  std::vector<byte> data;
+  if(!ReadFileData(GetCapabilityCachePath(), data))
+    return ret;
+
+  std::string text(data.begin(), data.end());
+
+  size_t start = 0;
+  while(start < text.size())
+  {
+    size_t end = text.find('\n', start);
+    if(end == std::string::npos)
+      end = text.size();
+
+    std::string line = text.substr(start, end - start);
+    start = end + 1;
+
+    size_t tab1 = line.find('\t');
+    size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+
+    if(tab2 == std::string::npos)
+      continue;
+
+    CachedCapability &cap = ret[line.substr(0, tab1)];
+    cap.identity = line.substr(tab1 + 1, tab2 - tab1 - 1);
+    cap.value = line.substr(tab2 + 1);
+  }
+
+  return ret;
+}
+
+static void WriteCapabilities(const std::map<std::string, CachedCapability> &caps)
+{
+  std::string text;
+
+  for(auto it = caps.begin(); it != caps.end(); ++it)
+    text += it->first + "\t" + it->second.identity + "\t" + it->second.value + "\n";
+
+  WriteFileAtomically(GetCapabilityCachePath(), text.data(), text.size());
+}
+
+static std::string SanitiseCapability(std::string str)
+{
+  for(char &c : str)
+    if(c == '\t' || c == '\n' || c == '\r')
+      c = ' ';
+
+  return str;
+}
+
+void SetCapabilityCacheEnabled(bool enabled)
+{
+  capabilityCacheEnabled = enabled;
+}
+
+bool GetCachedCapability(const std::string &key, const std::string &identity, std::string &value)
+{
+  if(!capabilityCacheEnabled)
+    return false;
+
+  std::lock_guard<std::mutex> lock(capabilityLock);
+
+  std::map<std::string, CachedCapability> caps = ReadCapabilities();
+
+  auto it = caps.find(SanitiseCapability(key));
+
+  if(it == caps.end() || it->second.identity != SanitiseCapability(identity))
+    return false;
+
+  value = it->second.value;
+  return true;
+}
+
+void SetCachedCapability(const std::string &key, const std::string &identity,
+                         const std::string &value)
+{
+  if(!capabilityCacheEnabled)
+    return;
+
+  std::lock_guard<std::mutex> lock(capabilityLock);
+
+  // re-read so that entries written by other processes since we last looked are kept
+  std::map<std::string, CachedCapability> caps = ReadCapabilities();
+
+  CachedCapability &cap = caps[SanitiseCapability(key)];
+  cap.identity = SanitiseCapability(identity);
+  cap.value = SanitiseCapability(value);
+
+  WriteCapabilities(caps);
+}
+
+void ForgetCachedCapability(const std::string &key)
+{
+  if(!capabilityCacheEnabled)
+    return;
+
+  std::lock_guard<std::mutex> lock(capabilityLock);
+
+  std::map<std::string, CachedCapability> caps = ReadCapabilities();
+
+  if(caps.erase(SanitiseCapability(key)) > 0)
+    WriteCapabilities(caps);
+}
+
+static bool resourceSharing = false;
+static std::vector<std::function<void()>> sharedReleases;
+
+void SetResourceSharing(bool enabled)
+{
+  resourceSharing = enabled;
+}
+
+bool IsResourceSharingEnabled()
+{
+  return resourceSharing;
+}
+
+void AddSharedRelease(std::function<void()> release)
+{
+  sharedReleases.push_back(release);
+}
+
+void ReleaseSharedResources()
+{
+  // release in reverse order, in case later resources depend on earlier ones
+  for(auto it = sharedReleases.rbegin(); it != sharedReleases.rend(); ++it)
+    (*it)();
+
+  sharedReleases.clear();
+}
+
+static uint32_t CRC32(const byte *data, size_t len, uint32_t crc = 0)
+{
+  static uint32_t table[256] = {};
+
+  if(table[1] == 0)
+  {
+    for(uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for(int k = 0; k < 8; k++)
+        c = (c & 1) ? 0xedb88320U ^ (c >> 1) : (c >> 1);
+      table[i] = c;
+    }
+  }
+
+  crc = ~crc;
+  for(size_t i = 0; i < len; i++)
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+static void AppendBigEndian(std::vector<byte> &out, uint32_t val)
+{
+  out.push_back(byte(val >> 24));
+  out.push_back(byte(val >> 16));
+  out.push_back(byte(val >> 8));
+  out.push_back(byte(val));
+}
+
+static void AppendPNGChunk(std::vector<byte> &out, const char *type, const std::vector<byte> &data)
+{
+  AppendBigEndian(out, (uint32_t)data.size());
+
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+
+  AppendBigEndian(out, CRC32(out.data() + start, out.size() - start));
+}
+
+bool WritePNG(const std::string &path, uint32_t width, uint32_t height,
+              const std::vector<byte> &rgba)
+{
+  if(rgba.size() < size_t(width) * height * 4)
+    return false;
+
+  // each row is prefixed with filter type 0 (none)
+  const size_t rowSize = size_t(width) * 4;
+  std::vector<byte> raw;
+  raw.reserve((rowSize + 1) * height);
+
+  for(uint32_t y = 0; y < height; y++)
+  {
+    raw.push_back(0);
+    raw.insert(raw.end(), rgba.begin() + y * rowSize, rgba.begin() + (y + 1) * rowSize);
+  }
+
+  // a zlib stream of stored (uncompressed) deflate blocks. Size isn't a concern, it just has to be
+  // readable by anything that reads PNGs
+  std::vector<byte> zlib = {0x78, 0x01};
+
+  uint32_t a = 1, b = 0;
+  for(byte c : raw)
+  {
+    a = (a + c) % 65521;
+    b = (b + a) % 65521;
+  }
+
+  size_t offs = 0;
+  do
+  {
+    uint16_t len = (uint16_t)std::min<size_t>(raw.size() - offs, 65535);
+    bool final = offs + len == raw.size();
+
+    zlib.push_back(final ? 1 : 0);
+    zlib.push_back(byte(len & 0xff));
+    zlib.push_back(byte(len >> 8));
+    zlib.push_back(byte(~len & 0xff));
+    zlib.push_back(byte((~len >> 8) & 0xff));
+    zlib.insert(zlib.end(), raw.begin() + offs, raw.begin() + offs + len);
+
+    offs += len;
+  } while(offs < raw.size());
+
+  AppendBigEndian(zlib, (b << 16) | a);
+
+  std::vector<byte> header;
+  AppendBigEndian(header, width);
+  AppendBigEndian(header, height);
+  // 8 bits per channel, RGBA, default compression/filtering, not interlaced
+  header.insert(header.end(), {8, 6, 0, 0, 0});
+
+  std::vector<byte> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+  AppendPNGChunk(png, "IHDR", header);
+  AppendPNGChunk(png, "IDAT", zlib);
+  AppendPNGChunk(png, "IEND", {});
+
+  return WriteFileAtomically(path, png.data(), png.size());
+}
+
+struct AsyncWrite
+{
+  std::string path;
+  uint32_t width, height;
+  std::vector<byte> rgba;
+};
+
+// writes are queued for a single writer thread, started by the first write and stopped once the
+// queue has been drained by FinishAsyncWrites
+static std::mutex asyncWriteLock;
+static std::condition_variable asyncWriteReady;
+static std::deque<AsyncWrite> asyncWrites;
+static std::thread asyncWriter;
+static bool asyncWritesFinishing = false;
+
+static void AsyncWriterThread()
+{
+  std::unique_lock<std::mutex> lock(asyncWriteLock);
+
+  while(true)
+  {
+    asyncWriteReady.wait(lock, []() { return asyncWritesFinishing || !asyncWrites.empty(); });
+
+    if(asyncWrites.empty())
+      return;
+
+    AsyncWrite write = std::move(asyncWrites.front());
+    asyncWrites.pop_front();
+
+    lock.unlock();
+
+    if(!WritePNG(write.path, write.width, write.height, write.rgba))
+      TEST_WARN("Couldn't write '%s'", write.path.c_str());
+
+    lock.lock();
+  }
+}
+
+void WritePNGAsync(const std::string &path, uint32_t width, uint32_t height,
+                   std::vector<byte> &&rgba)
+{
+  {
+    std::lock_guard<std::mutex> lock(asyncWriteLock);
+
+    asyncWrites.push_back({path, width, height, std::move(rgba)});
+
+    if(!asyncWriter.joinable())
+      asyncWriter = std::thread(AsyncWriterThread);
+  }
+
+  asyncWriteReady.notify_one();
+}
+
+void FinishAsyncWrites()
+{
+  {
+    std::lock_guard<std::mutex> lock(asyncWriteLock);
+
+    if(!asyncWriter.joinable())
+      return;
+
+    asyncWritesFinishing = true;
+  }
+
+  asyncWriteReady.notify_one();
+  asyncWriter.join();
+
+  asyncWritesFinishing = false;
+}
+
+// shaders can be compiled on worker threads, so each thread formats into its own buffer
+static thread_local char printBuf[4096] = {};
 
 void DebugPrint(const char *fmt, ...)
 {
@@ -102,6 +525,100 @@ void DebugPrint(const char *fmt, ...)
 
 static shaderc_compiler_t shaderc = NULL;
 
+#ifndef HAVE_PRECOMPILED_SPIRV
+#define HAVE_PRECOMPILED_SPIRV 0
+#endif
+
+#if HAVE_PRECOMPILED_SPIRV
+extern const PrecompiledSpv precompiledSpv[];
+extern const size_t precompiledSpvCount;
+#else
+static const PrecompiledSpv *precompiledSpv = NULL;
+static const size_t precompiledSpvCount = 0;
+#endif
+
+struct TraceEvent
+{
+  const char *name;
+  uint32_t tid;
+  double start, duration;
+};
+
+static std::mutex traceLock;
+static std::atomic<bool> traceEnabled{false};
+static std::string tracePath;
+static std::chrono::steady_clock::time_point traceStart;
+static std::vector<TraceEvent> traceEvents;
+static std::vector<std::thread::id> traceThreads;
+
+void EnableTrace(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(traceLock);
+
+  tracePath = path;
+  traceStart = std::chrono::steady_clock::now();
+  traceEnabled = true;
+}
+
+ProfileZone::ProfileZone(const char *zoneName) : name(zoneName)
+{
+  if(traceEnabled)
+    start = std::chrono::steady_clock::now();
+}
+
+ProfileZone::~ProfileZone()
+{
+  if(!traceEnabled)
+    return;
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(traceLock);
+
+  // number threads in the order they're first seen, so the main thread is always 0
+  std::thread::id id = std::this_thread::get_id();
+  auto it = std::find(traceThreads.begin(), traceThreads.end(), id);
+  uint32_t tid = uint32_t(it - traceThreads.begin());
+  if(it == traceThreads.end())
+    traceThreads.push_back(id);
+
+  TraceEvent ev;
+  ev.name = name;
+  ev.tid = tid;
+  ev.start = std::chrono::duration<double, std::micro>(start - traceStart).count();
+  ev.duration = std::chrono::duration<double, std::micro>(end - start).count();
+  traceEvents.push_back(ev);
+}
+
+void WriteTrace()
+{
+  if(!traceEnabled)
+    return;
+
+  std::lock_guard<std::mutex> lock(traceLock);
+
+  std::string json = "{\"traceEvents\": [\n";
+
+  for(size_t i = 0; i < traceEvents.size(); i++)
+  {
+    const TraceEvent &ev = traceEvents[i];
+
+    char line[512];
+    snprintf(line, sizeof(line) - 1,
+             "  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, "
+             "\"dur\": %.3f}%s\n",
+             ev.name, ev.tid, ev.start, ev.duration, i + 1 < traceEvents.size() ? "," : "");
+    json += line;
+  }
+
+  json += "]}\n";
+
+  if(!WriteFileAtomically(tracePath, json.data(), json.size()))
+    TEST_WARN("Couldn't write trace to '%s'", tracePath.c_str());
+}
+
+static std::string GetCompilerIdentity();
+
 bool SpvCompilationSupported()
 {
   if(shaderc)
@@ -114,24 +631,303 @@ bool SpvCompilationSupported()
   if(shaderc)
     return true;
 
+  // with no glslc in PATH there's nothing to run
+  std::string identity = GetCompilerIdentity();
+
+  if(identity.empty())
+    return false;
+
+  // running glslc is slow, so remember the result for this particular glslc binary
+  std::string cached;
+
+  if(GetCachedCapability("glslc", identity, cached))
+    return cached == "1";
+
   FILE *pipe = popen("glslc" EXECUTABLE_SUFFIX " --help", "r");
 
-  if(!pipe)
+  bool supported = false;
+
+  if(pipe)
+  {
+    // drain the help text so glslc can't block on a full pipe, then pclose waits for it to exit
+    char buf[256];
+    while(fgets(buf, sizeof(buf), pipe))
+    {
+    }
+
+    int code = pclose(pipe);
+
+    supported = WEXITSTATUS(code) == 0;
+  }
+
+  SetCachedCapability("glslc", identity, supported ? "1" : "0");
+
+  return supported;
+}
+
+bool HavePrecompiledSpv()
+{
+  return precompiledSpvCount > 0;
+}
+
+static const char *ShaderLangName(ShaderLang lang)
+{
+  switch(lang)
+  {
+    case ShaderLang::glsl: return "glsl";
+    case ShaderLang::hlsl: return "hlsl";
+  }
+
+  return "unknown";
+}
+
+static const char *ShaderStageName(ShaderStage stage)
+{
+  switch(stage)
+  {
+    case ShaderStage::vert: return "vert";
+    case ShaderStage::tesscontrol: return "tesscontrol";
+    case ShaderStage::tesseval: return "tesseval";
+    case ShaderStage::geom: return "geom";
+    case ShaderStage::frag: return "frag";
+    case ShaderStage::comp: return "comp";
+  }
+
+  return "unknown";
+}
+
+// identifies the compiler that will be used, so that cached SPIR-V is invalidated when it changes
+static std::string GetCompilerIdentity()
+{
+  std::string ret;
+  uint64_t size = 0, modified = 0;
+
+#if USE_LINKED_SHADERC
+  // like glslc below, stamp the binary shaderc lives in. If it was linked statically that's the
+  // demos themselves, so rebuilding them is enough to invalidate the cache
+  if(shaderc)
+  {
+    std::string lib = GetModulePath((const void *)&shaderc_compile_into_spv);
+
+    if(lib.empty() || !GetFileStamp(lib, size, modified))
+      return "";
+
+    ret = "shaderc " + lib + " " + std::to_string(size) + " " + std::to_string(modified);
+    return ret;
+  }
+#endif
+
+  std::string glslc = FindInPath("glslc" EXECUTABLE_SUFFIX);
+
+  if(glslc.empty() || !GetFileStamp(glslc, size, modified))
+    return "";
+
+  ret = "glslc " + glslc + " " + std::to_string(size) + " " + std::to_string(modified);
+
+  return ret;
+}
+
+static bool spvCacheEnabled = true;
+
+// printed at exit, if the cache was used at all
+static struct SpvCacheStats
+{
+  std::atomic<int> hits{0}, misses{0}, precompiled{0};
+
+  ~SpvCacheStats()
+  {
+    if(hits + misses + precompiled > 0)
+      DebugPrint("SPIR-V cache: %d hits, %d misses, %d precompiled\n", hits.load(), misses.load(),
+                 precompiled.load());
+  }
+} spvCacheStats;
+
+void SetSpvCacheEnabled(bool enabled)
+{
+  spvCacheEnabled = enabled;
+}
+
+// this must match shader_key() in precompile_spirv.py
+static uint64_t GetSpvKeyHash(const std::string &source_text, ShaderLang lang, ShaderStage stage,
+                              const char *entry_point)
+{
+  std::string key = ShaderLangName(lang);
+  key += '\0';
+  key += ShaderStageName(stage);
+  key += '\0';
+  key += entry_point;
+  key += '\0';
+  key += source_text;
+
+  return HashString(key);
+}
+
+static bool FindPrecompiledSpv(uint64_t hash, std::vector<uint32_t> &spirv)
+{
+  const PrecompiledSpv *end = precompiledSpv + precompiledSpvCount;
+  const PrecompiledSpv *it = std::lower_bound(
+      precompiledSpv, end, hash,
+      [](const PrecompiledSpv &a, uint64_t b) { return a.hash < b; });
+
+  if(it == end || it->hash != hash)
     return false;
 
-  msleep(20);
+  spirv.assign(it->words, it->words + it->count);
+  return true;
+}
 
-  int code = pclose(pipe);
+static std::string GetSpvCachePath(uint64_t hash)
+{
+  static std::string compiler = GetCompilerIdentity();
+
+  // a compiler that can't be identified can't be cached, since we'd never notice it changing
+  if(compiler.empty())
+    return "";
+
+  hash = HashString(compiler, hash);
+
+  char filename[32] = {};
+  snprintf(filename, sizeof(filename) - 1, "%016llx.spv", (unsigned long long)hash);
 
-  return WEXITSTATUS(code) == 0;
+  return GetCacheDir() + "/spirv/" + filename;
+}
+
+static bool ReadSpvFile(const std::string &path, std::vector<uint32_t> &spirv)
+{
+  std::vector<byte> data;
+  if(!ReadFileData(path, data) || data.empty() || (data.size() % sizeof(uint32_t)) != 0)
+    return false;
+
+  spirv.resize(data.size() / sizeof(uint32_t));
+  memcpy(&spirv[0], data.data(), data.size());
+
+  // check the SPIR-V magic number so that corrupt files aren't used
+  if(spirv[0] != 0x07230203)
+  {
+    spirv.clear();
+    return false;
+  }
+
+  return true;
+}
+
+static void WriteSpvFile(const std::string &path, const std::vector<uint32_t> &spirv)
+{
+  WriteFileAtomically(path, spirv.data(), spirv.size() * sizeof(uint32_t));
+}
+
+static std::vector<uint32_t> InvokeCompiler(shaderc_compiler_t compiler,
+                                            const std::string &source_text, ShaderLang lang,
+                                            ShaderStage stage, const char *entry_point);
+
+static std::vector<uint32_t> CompileShaderToSpv(shaderc_compiler_t compiler,
+                                                const std::string &source_text, ShaderLang lang,
+                                                ShaderStage stage, const char *entry_point)
+{
+  PROFILE_ZONE("CompileShaderToSpv");
+
+  std::vector<uint32_t> ret;
+
+  uint64_t hash = GetSpvKeyHash(source_text, lang, stage, entry_point);
+
+  if(FindPrecompiledSpv(hash, ret))
+  {
+    spvCacheStats.precompiled++;
+    return ret;
+  }
+
+  // shaders that weren't precompiled, e.g. ones generated at runtime, still need a compiler
+  static bool compilerAvailable = SpvCompilationSupported();
+
+  if(!compilerAvailable)
+  {
+    TEST_ERROR("Shader wasn't precompiled, and glslc must be in PATH to compile it");
+    return ret;
+  }
+
+  std::string cachePath = spvCacheEnabled ? GetSpvCachePath(hash) : std::string();
+
+  if(cachePath.empty())
+    return InvokeCompiler(compiler, source_text, lang, stage, entry_point);
+
+  if(ReadSpvFile(cachePath, ret))
+  {
+    spvCacheStats.hits++;
+    return ret;
+  }
+
+  spvCacheStats.misses++;
+
+  ret = InvokeCompiler(compiler, source_text, lang, stage, entry_point);
+
+  if(!ret.empty())
+    WriteSpvFile(cachePath, ret);
+
+  return ret;
 }
 
 std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderLang lang,
                                          ShaderStage stage, const char *entry_point)
 {
+  return CompileShaderToSpv(shaderc, source_text, lang, stage, entry_point);
+}
+
+std::vector<std::vector<uint32_t>> CompileShadersToSpv(const std::vector<ShaderCompileJob> &jobs)
+{
+  PROFILE_ZONE("CompileShadersToSpv");
+
+  std::vector<std::vector<uint32_t>> ret(jobs.size());
+
+  if(jobs.empty())
+    return ret;
+
+  uint32_t numThreads = std::max(1U, std::thread::hardware_concurrency());
+  numThreads = std::min(numThreads, (uint32_t)jobs.size());
+
+  // each worker pulls the next job until they're all done. With linked shaderc every worker has
+  // its own compiler instance, otherwise each one runs its own glslc process.
+  std::atomic<size_t> nextJob{0};
+
+  auto worker = [&jobs, &ret, &nextJob]() {
+    shaderc_compiler_t compiler = NULL;
+
+#if USE_LINKED_SHADERC
+    if(shaderc)
+      compiler = shaderc_compiler_initialize();
+#endif
+
+    for(size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+      ret[i] = CompileShaderToSpv(compiler, jobs[i].source_text, jobs[i].lang, jobs[i].stage,
+                                  jobs[i].entry_point);
+
+#if USE_LINKED_SHADERC
+    if(compiler)
+      shaderc_compiler_release(compiler);
+#endif
+  };
+
+  std::vector<std::thread> threads;
+  for(uint32_t t = 1; t < numThreads; t++)
+    threads.push_back(std::thread(worker));
+
+  // the calling thread does work too
+  worker();
+
+  for(std::thread &t : threads)
+    t.join();
+
+  return ret;
+}
+
+static std::vector<uint32_t> InvokeCompiler(shaderc_compiler_t compiler,
+                                            const std::string &source_text, ShaderLang lang,
+                                            ShaderStage stage, const char *entry_point)
+{
+  PROFILE_ZONE("InvokeCompiler");
+
   std::vector<uint32_t> ret;
 
-  if(shaderc)
+  if(compiler)
   {
 #if USE_LINKED_SHADERC
     shaderc_compile_options_t opts = shaderc_compile_options_initialize();
@@ -156,8 +952,9 @@ std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderL
       case ShaderStage::comp: shader_kind = shaderc_compute_shader; break;
     }
 
-    shaderc_compilation_result_t res = shaderc_compile_into_spv(
-        shaderc, source_text.c_str(), source_text.size(), shader_kind, "inshader", entry_point, opts);
+    shaderc_compilation_result_t res =
+        shaderc_compile_into_spv(compiler, source_text.c_str(), source_text.size(), shader_kind,
+                                 "inshader", entry_point, opts);
 
     shaderc_compilation_status status = shaderc_result_get_compilation_status(res);
 
@@ -169,6 +966,8 @@ std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderL
       if(res)
         shaderc_result_release(res);
 
+      shaderc_compile_options_release(opts);
+
       return ret;
     }
 
@@ -208,17 +1007,22 @@ std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderL
     case ShaderStage::comp: command_line += " -fshader-stage=comp"; break;
   }
 
-  char infile[MAX_PATH] = {};
-  char outfile[MAX_PATH] = {};
-  tmpnam(infile);
-  tmpnam(outfile);
+  // these are created uniquely, so concurrent compiles never collide
+  std::string infile = MakeTempFile();
+  std::string outfile = MakeTempFile();
+
+  if(infile.empty() || outfile.empty())
+  {
+    TEST_ERROR("Couldn't create temporary files to compile shaders.");
+    return ret;
+  }
 
   command_line += " -o ";
   command_line += outfile;
   command_line += " ";
   command_line += infile;
 
-  FILE *f = fopen(infile, "wb");
+  FILE *f = fopen(infile.c_str(), "wb");
   if(f)
   {
     fwrite(source_text.c_str(), 1, source_text.size(), f);
@@ -230,20 +1034,23 @@ std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderL
   if(!pipe)
   {
     TEST_ERROR("Couldn't run shaderc to compile shaders.");
+    unlink(infile.c_str());
+    unlink(outfile.c_str());
     return ret;
   }
 
-  msleep(100);
-
+  // pclose waits for the compiler to exit, so the output is complete after this
   int code = pclose(pipe);
 
   if(code != 0)
   {
     TEST_ERROR("Invoking shaderc failed: %s.", command_line.c_str());
+    unlink(infile.c_str());
+    unlink(outfile.c_str());
     return ret;
   }
 
-  f = fopen(outfile, "rb");
+  f = fopen(outfile.c_str(), "rb");
   if(f)
   {
     fseek(f, 0, SEEK_END);
@@ -253,8 +1060,8 @@ std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderL
     fclose(f);
   }
 
-  unlink(infile);
-  unlink(outfile);
+  unlink(infile.c_str());
+  unlink(outfile.c_str());
 
   return ret;
 }
@@ -272,11 +1079,42 @@ bool GraphicsTest::Init(int argc, char **argv)
       debugDevice = true;
     }
 
+    if(!strcmp(argv[i], "--headless") || !strcmp(argv[i], "-headless"))
+    {
+      headless = true;
+    }
+
+    if(i + 1 < argc && !strcmp(argv[i], "--cache-dir"))
+    {
+      SetCacheDir(argv[i + 1]);
+    }
+
+    if(!strcmp(argv[i], "--no-spirv-cache"))
+    {
+      SetSpvCacheEnabled(false);
+    }
+
     if(i + 1 < argc && (!strcmp(argv[i], "--frames") || !strcmp(argv[i], "--framecount") ||
                         !strcmp(argv[i], "--max-frames")))
     {
       maxFrameCount = atoi(argv[i + 1]);
     }
+
+    if(i + 2 < argc && !strcmp(argv[i], "--dump-frame"))
+    {
+      dumpFrame = atoi(argv[i + 1]);
+      dumpFramePath = argv[i + 2];
+    }
+
+    if(i + 1 < argc && !strcmp(argv[i], "--warmup"))
+    {
+      warmupFrames = std::max(0, atoi(argv[i + 1]));
+    }
+
+    if(i + 1 < argc && !strcmp(argv[i], "--perf-report"))
+    {
+      perfReportPath = argv[i + 1];
+    }
   }
 
 #if defined(WIN32)
@@ -301,9 +1139,68 @@ bool GraphicsTest::Init(int argc, char **argv)
 
 bool GraphicsTest::FrameLimit()
 {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  // this is called once between each frame, so the time since the last call is the frame that just
+  // finished. The first call only starts the clock
+  if(curFrame > 0 && curFrame > warmupFrames)
+    frameTimes.push_back(std::chrono::duration<double, std::milli>(now - lastFrameTime).count());
+
+  lastFrameTime = now;
+
   curFrame++;
   if(maxFrameCount > 0 && curFrame >= maxFrameCount)
     return false;
 
   return true;
 }
+
+FrameTimeStats GraphicsTest::GetFrameTimeStats() const
+{
+  FrameTimeStats ret;
+
+  if(frameTimes.empty())
+    return ret;
+
+  std::vector<double> sorted = frameTimes;
+  std::sort(sorted.begin(), sorted.end());
+
+  auto percentile = [&sorted](double p) {
+    return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+  };
+
+  ret.frames = sorted.size();
+  ret.min = sorted.front();
+  ret.median = percentile(0.5);
+  ret.p95 = percentile(0.95);
+  ret.p99 = percentile(0.99);
+  ret.max = sorted.back();
+
+  return ret;
+}
+
+void GraphicsTest::ReportFrameTimes(const std::string &testName)
+{
+  FrameTimeStats stats = GetFrameTimeStats();
+
+  if(stats.frames == 0)
+    return;
+
+  TEST_LOG("%zu frames timed after %d warm-up. CPU frame time min %.3f ms, median %.3f ms, "
+           "p95 %.3f ms, p99 %.3f ms, max %.3f ms",
+           stats.frames, warmupFrames, stats.min, stats.median, stats.p95, stats.p99, stats.max);
+
+  if(perfReportPath.empty())
+    return;
+
+  char json[1024];
+  int len = snprintf(json, sizeof(json) - 1,
+                     "{\n  \"test\": \"%s\",\n  \"warmup_frames\": %d,\n  \"frames\": %zu,\n"
+                     "  \"min_ms\": %f,\n  \"median_ms\": %f,\n"
+                     "  \"p95_ms\": %f,\n  \"p99_ms\": %f,\n  \"max_ms\": %f\n}\n",
+                     testName.c_str(), warmupFrames, stats.frames, stats.min, stats.median,
+                     stats.p95, stats.p99, stats.max);
+
+  if(len < 0 || !WriteFileAtomically(perfReportPath, json, (size_t)len))
+    TEST_WARN("Couldn't write performance report to '%s'", perfReportPath.c_str());
+}
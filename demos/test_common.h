@@ -34,6 +34,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <algorithm>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -57,9 +59,34 @@ enum class ShaderStage
 };
 
 bool SpvCompilationSupported();
+// true if the demos' shaders were compiled at build time, in which case only shaders assembled at
+// runtime need a compiler
+bool HavePrecompiledSpv();
 std::vector<uint32_t> CompileShaderToSpv(const std::string &source_text, ShaderLang lang,
                                          ShaderStage stage, const char *entry_point);
 
+struct ShaderCompileJob
+{
+  std::string source_text;
+  ShaderLang lang;
+  ShaderStage stage;
+  const char *entry_point = "main";
+};
+
+// compiles all the jobs in parallel, returning the SPIR-V in the same order as the jobs
+std::vector<std::vector<uint32_t>> CompileShadersToSpv(const std::vector<ShaderCompileJob> &jobs);
+
+// SPIR-V compiled at build time by precompile_spirv.py, sorted by hash
+struct PrecompiledSpv
+{
+  uint64_t hash;
+  const uint32_t *words;
+  size_t count;
+};
+
+// compiled SPIR-V is cached on disk under GetCacheDir(), this can be used to disable it
+void SetSpvCacheEnabled(bool enabled);
+
 struct Vec2f
 {
   Vec2f(float X = 0.0f, float Y = 0.0f)
@@ -121,19 +148,37 @@ struct GraphicsWindow
   virtual bool Update() = 0;
 };
 
+// CPU frame time percentiles in milliseconds, over the frames after the warm-up
+struct FrameTimeStats
+{
+  size_t frames = 0;
+  double min = 0.0, median = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+};
+
 struct GraphicsTest
 {
   virtual ~GraphicsTest() {}
   virtual GraphicsWindow *MakeWindow(int width, int height, const char *title) { return NULL; }
   virtual int main(int argc, char **argv) { return 9; }
-  virtual bool IsSupported() { return false; }
   virtual bool Init(int argc, char **argv);
 
   bool FrameLimit();
 
+  FrameTimeStats GetFrameTimeStats() const;
+  void ReportFrameTimes(const std::string &testName);
+
   int curFrame = 0;
   int maxFrameCount = -1;
 
+  // --dump-frame N file writes frame N's backbuffer out to a PNG
+  int dumpFrame = -1;
+  std::string dumpFramePath;
+
+  int warmupFrames = 0;
+  std::string perfReportPath;
+  std::vector<double> frameTimes;
+  std::chrono::steady_clock::time_point lastFrameTime;
+
   int screenWidth = 400;
   int screenHeight = 300;
   const char *screenTitle = "RenderDoc test program";
@@ -158,7 +203,11 @@ struct TestMetadata
   TestAPI API;
   const char *Name;
   const char *Description;
-  GraphicsTest *test;
+
+  // tests are only constructed when they're run, and whether the API is usable is only probed
+  // when it's needed - so that listing tests or launching one doesn't initialise every API
+  GraphicsTest *(*Create)();
+  bool (*IsSupported)();
 
   std::string QualifiedName() const
   {
@@ -186,38 +235,84 @@ struct TestMetadata
     if(API != o.API)
       return API < o.API;
 
-    int ret = strcmp(Name, o.Name);
-    if(ret != 0)
-      return ret < 0;
-
-    return test < o.test;
+    return strcmp(Name, o.Name) < 0;
   }
 };
 
 void RegisterTest(TestMetadata test);
 
-#define REGISTER_TEST(TestName)                 \
-  namespace                                     \
-  {                                             \
-  struct TestRegistration                       \
-  {                                             \
-    TestName m_impl;                            \
-    TestRegistration()                          \
-    {                                           \
-      TestMetadata test;                        \
-      test.API = TestName::API;                 \
-      test.Name = #TestName;                    \
-      test.Description = TestName::Description; \
-      test.test = &m_impl;                      \
-      if(m_impl.IsSupported())                  \
-        RegisterTest(test);                     \
-    }                                           \
-  };                                            \
-  };                                            \
+#define REGISTER_TEST(TestName)                               \
+  namespace                                                   \
+  {                                                           \
+  struct TestRegistration                                     \
+  {                                                           \
+    static GraphicsTest *Create() { return new TestName(); }  \
+    TestRegistration()                                        \
+    {                                                         \
+      TestMetadata test;                                      \
+      test.API = TestName::API;                               \
+      test.Name = #TestName;                                  \
+      test.Description = TestName::Description;               \
+      test.Create = &Create;                                  \
+      test.IsSupported = &TestName::IsSupported;              \
+      RegisterTest(test);                                     \
+    }                                                         \
+  };                                                          \
+  };                                                          \
   static TestRegistration Anon##__LINE__;
 
 std::string GetCWD();
 
+// platform-specific filesystem helpers
+std::string GetDefaultCacheDir();
+bool MakeDir(const std::string &path);
+std::string FindInPath(const std::string &exe);
+bool GetFileStamp(const std::string &path, uint64_t &size, uint64_t &modified);
+// the executable or shared library that contains the given code or data
+std::string GetModulePath(const void *address);
+std::string MakeTempFile();
+
+// whole-file read, and a write that goes via a temporary file so readers never see partial data
+bool ReadFileData(const std::string &path, std::vector<byte> &data);
+bool WriteFileAtomically(const std::string &path, const void *data, size_t size);
+
+// called with a backbuffer's contents as tightly packed RGBA8 rows, top row first
+typedef std::function<void(uint32_t width, uint32_t height, std::vector<byte> &rgba)>
+    ReadbackCallback;
+
+// an uncompressed RGBA8 PNG. The async version queues the encode and write for a background
+// thread, and FinishAsyncWrites waits for the queue to drain
+bool WritePNG(const std::string &path, uint32_t width, uint32_t height,
+              const std::vector<byte> &rgba);
+void WritePNGAsync(const std::string &path, uint32_t width, uint32_t height,
+                   std::vector<byte> &&rgba);
+void FinishAsyncWrites();
+
+// root folder for any persistent caches, defaults to GetDefaultCacheDir() unless overridden with
+// --cache-dir
+void SetCacheDir(const std::string &dir);
+std::string GetCacheDir();
+
+// probed capabilities are cached under GetCacheDir() so that every launch doesn't re-probe the
+// same system. Each value is stored with an identity describing what it was probed from, such as
+// tool paths and timestamps or driver versions, and is treated as stale once that changes.
+bool GetCachedCapability(const std::string &key, const std::string &identity, std::string &value);
+void SetCachedCapability(const std::string &key, const std::string &identity,
+                         const std::string &value);
+void ForgetCachedCapability(const std::string &key);
+void SetCapabilityCacheEnabled(bool enabled);
+
+// when several tests run in one process, a test can hand expensive API objects such as its device
+// to the next compatible test instead of destroying them. Whatever is still shared at the end is
+// destroyed by the callbacks passed to AddSharedRelease.
+void SetResourceSharing(bool enabled);
+bool IsResourceSharingEnabled();
+void AddSharedRelease(std::function<void()> release);
+void ReleaseSharedResources();
+
+uint64_t HashBytes(const void *data, size_t len, uint64_t seed = 0xcbf29ce484222325ULL);
+uint64_t HashString(const std::string &str, uint64_t seed = 0xcbf29ce484222325ULL);
+
 #ifndef ARRAY_COUNT
 #define ARRAY_COUNT(arr) (sizeof(arr) / sizeof(arr[0]))
 #endif
@@ -230,6 +325,25 @@ std::string trim(const std::string &str);
 
 void DebugPrint(const char *fmt, ...);
 
+// a lightweight timeline profiler. Each PROFILE_ZONE records how long its enclosing scope took,
+// and the zones are written out as Chrome trace-event JSON (viewable in chrome://tracing or
+// Perfetto) if tracing was enabled with --trace. Zone names must be string literals.
+void EnableTrace(const std::string &path);
+void WriteTrace();
+
+struct ProfileZone
+{
+  ProfileZone(const char *zoneName);
+  ~ProfileZone();
+
+  const char *name;
+  std::chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_ZONE_CONCAT2(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_ZONE_CONCAT(profileZone, __LINE__)(name)
+
 #define TEST_ASSERT(cond, fmt, ...)                                                               \
   if(!(cond))                                                                                     \
   {                                                                                               \
@@ -104,10 +104,10 @@ void main()
         vkh::vertexAttrFormatted(2, 0, vertin, uv, VK_FORMAT_R64G64B64_SFLOAT),
     };
 
-    pipeCreateInfo.stages = {
-        CompileShaderModule(common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"),
-        CompileShaderModule(common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"),
-    };
+    pipeCreateInfo.stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+    });
 
     VkPipeline pipe = createGraphicsPipeline(pipeCreateInfo);
 
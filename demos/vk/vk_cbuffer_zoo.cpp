@@ -379,24 +379,26 @@ float4 main() : SV_Target0
         vkh::vertexAttr(2, 0, DefaultA2V, uv),
     };
 
-    pipeCreateInfo.stages = {
-        CompileShaderModule(common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"),
-        CompileShaderModule(common + glslpixel, ShaderLang::glsl, ShaderStage::frag, "main"),
-    };
+    std::vector<VkPipelineShaderStageCreateInfo> stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + glslpixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+        {hlslpixel, ShaderLang::hlsl, ShaderStage::frag, "main"},
+    });
+
+    pipeCreateInfo.stages = {stages[0], stages[1]};
 
     VkPipeline glslpipe = createGraphicsPipeline(pipeCreateInfo);
 
-    pipeCreateInfo.stages[1] =
-        CompileShaderModule(hlslpixel, ShaderLang::hlsl, ShaderStage::frag, "main");
+    pipeCreateInfo.stages[1] = stages[2];
 
     VkPipeline hlslpipe = createGraphicsPipeline(pipeCreateInfo);
 
     AllocatedBuffer vb(
         allocator, vkh::BufferCreateInfo(sizeof(DefaultTri), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
                                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT),
-        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_CPU_TO_GPU}));
+        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_GPU_ONLY}));
 
-    vb.upload(DefaultTri);
+    uploadBuffer(vb.buffer, DefaultTri);
 
     Vec4f cbufferdata[512];
 
@@ -406,9 +408,11 @@ float4 main() : SV_Target0
     AllocatedBuffer cb(
         allocator, vkh::BufferCreateInfo(sizeof(cbufferdata), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
                                                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT),
-        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_CPU_TO_GPU}));
+        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_GPU_ONLY}));
+
+    uploadBuffer(cb.buffer, cbufferdata);
 
-    cb.upload(cbufferdata);
+    flushUploads();
 
     VkDescriptorSet descset = allocateDescriptorSet(setlayout);
 
@@ -0,0 +1,259 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+
+#include <algorithm>
+#include <math.h>
+#include "vk_test.h"
+
+struct VK_Draw_Throughput : VulkanGraphicsTest
+{
+  static constexpr const char *Description =
+      "Issues a configurable number of tiny draws each frame, varying push constants, descriptor "
+      "sets and dynamic state between them, and reports CPU frame time percentiles.";
+
+  std::string common = R"EOSHADER(
+
+#version 420 core
+
+struct v2f
+{
+	vec4 pos;
+	vec4 col;
+	vec4 uv;
+};
+
+)EOSHADER";
+
+  const std::string vertex = R"EOSHADER(
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec4 Color;
+layout(location = 2) in vec2 UV;
+
+layout(push_constant) uniform PushData
+{
+  vec4 offsetScale;
+} push;
+
+layout(location = 0) out v2f vertOut;
+
+void main()
+{
+	vertOut.pos = vec4(Position.xy*push.offsetScale.zz + push.offsetScale.xy, Position.z, 1);
+	gl_Position = vertOut.pos;
+	vertOut.col = Color;
+	vertOut.uv = vec4(UV.xy, 0, 1);
+}
+
+)EOSHADER";
+
+  const std::string pixel = R"EOSHADER(
+
+layout(location = 0) in v2f vertIn;
+
+layout(set = 0, binding = 0, std140) uniform constsbuf
+{
+  vec4 tint;
+};
+
+layout(location = 0, index = 0) out vec4 Color;
+
+void main()
+{
+	Color = vertIn.col * tint;
+}
+
+)EOSHADER";
+
+  int main(int argc, char **argv)
+  {
+    // initialise, create window, create context, etc
+    if(!Init(argc, argv))
+      return 3;
+
+    uint32_t numDraws = 100000;
+    // how many draws between each descriptor set bind, and each dynamic state change
+    uint32_t bindInterval = 16;
+    uint32_t stateInterval = 64;
+
+    for(int i = 0; i < argc; i++)
+    {
+      if(i + 1 < argc && !strcmp(argv[i], "--draws"))
+        numDraws = std::max(1, atoi(argv[i + 1]));
+
+      if(i + 1 < argc && !strcmp(argv[i], "--bind-interval"))
+        bindInterval = std::max(1, atoi(argv[i + 1]));
+
+      if(i + 1 < argc && !strcmp(argv[i], "--state-interval"))
+        stateInterval = std::max(1, atoi(argv[i + 1]));
+    }
+
+    VkDescriptorSetLayout setlayout = createDescriptorSetLayout(vkh::DescriptorSetLayoutCreateInfo({
+        {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT},
+    }));
+
+    VkPipelineLayout layout = createPipelineLayout(vkh::PipelineLayoutCreateInfo(
+        {setlayout}, {vkh::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Vec4f))}));
+
+    vkh::GraphicsPipelineCreateInfo pipeCreateInfo;
+
+    pipeCreateInfo.layout = layout;
+    pipeCreateInfo.renderPass = swapRenderPass;
+
+    pipeCreateInfo.vertexInputState.vertexBindingDescriptions = {vkh::vertexBind(0, DefaultA2V)};
+    pipeCreateInfo.vertexInputState.vertexAttributeDescriptions = {
+        vkh::vertexAttr(0, 0, DefaultA2V, pos), vkh::vertexAttr(1, 0, DefaultA2V, col),
+        vkh::vertexAttr(2, 0, DefaultA2V, uv),
+    };
+
+    // scale the output by the blend constants, so that changing them is visible
+    pipeCreateInfo.dynamicState.dynamicStates.push_back(VK_DYNAMIC_STATE_BLEND_CONSTANTS);
+    pipeCreateInfo.colorBlendState.attachments[0].blendEnable = VK_TRUE;
+    pipeCreateInfo.colorBlendState.attachments[0].srcColorBlendFactor =
+        VK_BLEND_FACTOR_CONSTANT_COLOR;
+    pipeCreateInfo.colorBlendState.attachments[0].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    pipeCreateInfo.colorBlendState.attachments[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    pipeCreateInfo.colorBlendState.attachments[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+
+    pipeCreateInfo.stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+    });
+
+    VkPipeline pipe = createGraphicsPipeline(pipeCreateInfo);
+
+    AllocatedBuffer vb(
+        allocator, vkh::BufferCreateInfo(sizeof(DefaultTri), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_GPU_ONLY}));
+
+    uploadBuffer(vb.buffer, DefaultTri);
+
+    // one tint per descriptor set, each at an offset that satisfies any uniform buffer alignment
+    const uint32_t numSets = 16;
+    const uint32_t tintStride = 256;
+
+    byte tintData[numSets * tintStride] = {};
+
+    for(uint32_t i = 0; i < numSets; i++)
+    {
+      Vec4f tint(0.5f + 0.5f * (i & 1), 0.5f + 0.25f * ((i >> 1) & 3), 0.5f + 0.5f * (i >> 3),
+                 1.0f);
+      memcpy(tintData + i * tintStride, &tint, sizeof(tint));
+    }
+
+    AllocatedBuffer cb(
+        allocator, vkh::BufferCreateInfo(sizeof(tintData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_GPU_ONLY}));
+
+    uploadBuffer(cb.buffer, tintData);
+
+    flushUploads();
+
+    // lay the draws out in a grid covering the screen
+    uint32_t gridSize = (uint32_t)ceil(sqrt((double)numDraws));
+    float scale = 2.0f / gridSize;
+
+    std::vector<VkDescriptorSet> descsets(numSets);
+
+    while(Running())
+    {
+      // the sets are written every frame like a real renderer would, so they come from this frame
+      // slot's pools which are reset wholesale rather than freed one by one
+      for(uint32_t i = 0; i < numSets; i++)
+      {
+        descsets[i] = allocateFrameDescriptorSet(setlayout);
+
+        vkh::updateDescriptorSets(
+            device, {
+                        vkh::WriteDescriptorSet(
+                            descsets[i], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                            {vkh::DescriptorBufferInfo(cb.buffer, i * tintStride, sizeof(Vec4f))}),
+                    });
+      }
+
+      VkCommandBuffer cmd = GetCommandBuffer();
+
+      vkBeginCommandBuffer(cmd, vkh::CommandBufferBeginInfo());
+
+      VkImage swapimg =
+          StartUsingBackbuffer(cmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+      vkCmdClearColorImage(cmd, swapimg, VK_IMAGE_LAYOUT_GENERAL,
+                           vkh::ClearColorValue(0.4f, 0.5f, 0.6f, 1.0f), 1,
+                           vkh::ImageSubresourceRange());
+
+      vkCmdBeginRenderPass(
+          cmd, vkh::RenderPassBeginInfo(swapRenderPass, swapFramebuffers[swapIndex], scissor),
+          VK_SUBPASS_CONTENTS_INLINE);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe);
+      vkh::cmdBindVertexBuffers(cmd, 0, {vb.buffer}, {0});
+
+      for(uint32_t i = 0; i < numDraws; i++)
+      {
+        if(i % stateInterval == 0)
+        {
+          float c = 0.75f + 0.25f * ((i / stateInterval) & 1);
+          float blendConsts[4] = {c, c, c, 1.0f};
+
+          vkCmdSetViewport(cmd, 0, 1, &viewport);
+          vkCmdSetScissor(cmd, 0, 1, &scissor);
+          vkCmdSetBlendConstants(cmd, blendConsts);
+        }
+
+        if(i % bindInterval == 0)
+          vkh::cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0,
+                                     {descsets[(i / bindInterval) % numSets]}, {});
+
+        Vec4f offsetScale(-1.0f + scale * (0.5f + i % gridSize),
+                          -1.0f + scale * (0.5f + i / gridSize), scale * 0.5f, 0.0f);
+
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(offsetScale),
+                           &offsetScale);
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+      }
+
+      vkCmdEndRenderPass(cmd);
+
+      FinishUsingBackbuffer(cmd, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+      vkEndCommandBuffer(cmd);
+
+      Submit(0, 1, {cmd});
+
+      Present();
+    }
+
+    // the base class reports the frame time percentiles, and writes them with --perf-report
+    TEST_LOG("%u draws per frame, bind interval %u, state interval %u", numDraws, bindInterval,
+             stateInterval);
+
+    return 0;
+  }
+};
+
+REGISTER_TEST(VK_Draw_Throughput);
@@ -100,10 +100,10 @@ void main()
         vkh::vertexAttr(2, 0, DefaultA2V, uv),
     };
 
-    pipeCreateInfo.stages = {
-        CompileShaderModule(common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"),
-        CompileShaderModule(common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"),
-    };
+    pipeCreateInfo.stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+    });
 
     VkPipeline noInstPipe = createGraphicsPipeline(pipeCreateInfo);
 
@@ -105,6 +105,61 @@ void cmdPipelineBarrier(VkCommandBuffer cmd, const std::vector<VkImageMemoryBarr
                        img.data());
 }
 
+void cmdReleaseOwnership(VkCommandBuffer cmd, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+                         std::vector<VkImageMemoryBarrier> img,
+                         std::vector<VkBufferMemoryBarrier> buf,
+                         VkPipelineStageFlags srcStageMask)
+{
+  if(srcQueueFamily == dstQueueFamily)
+  {
+    cmdPipelineBarrier(cmd, img, buf, {}, srcStageMask, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    return;
+  }
+
+  // the destination access is ignored for a release, it's made available by the acquire
+  for(VkImageMemoryBarrier &b : img)
+  {
+    b.dstAccessMask = 0;
+    b.srcQueueFamilyIndex = srcQueueFamily;
+    b.dstQueueFamilyIndex = dstQueueFamily;
+  }
+
+  for(VkBufferMemoryBarrier &b : buf)
+  {
+    b.dstAccessMask = 0;
+    b.srcQueueFamilyIndex = srcQueueFamily;
+    b.dstQueueFamilyIndex = dstQueueFamily;
+  }
+
+  cmdPipelineBarrier(cmd, img, buf, {}, srcStageMask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+}
+
+void cmdAcquireOwnership(VkCommandBuffer cmd, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+                         std::vector<VkImageMemoryBarrier> img,
+                         std::vector<VkBufferMemoryBarrier> buf,
+                         VkPipelineStageFlags dstStageMask)
+{
+  if(srcQueueFamily == dstQueueFamily)
+    return;
+
+  // likewise the source access was already made available by the release
+  for(VkImageMemoryBarrier &b : img)
+  {
+    b.srcAccessMask = 0;
+    b.srcQueueFamilyIndex = srcQueueFamily;
+    b.dstQueueFamilyIndex = dstQueueFamily;
+  }
+
+  for(VkBufferMemoryBarrier &b : buf)
+  {
+    b.srcAccessMask = 0;
+    b.srcQueueFamilyIndex = srcQueueFamily;
+    b.dstQueueFamilyIndex = dstQueueFamily;
+  }
+
+  cmdPipelineBarrier(cmd, img, buf, {}, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask);
+}
+
 void cmdBindVertexBuffers(VkCommandBuffer cmd, uint32_t firstBinding,
                           std::initializer_list<VkBuffer> bufs,
                           std::initializer_list<VkDeviceSize> offsets)
@@ -151,6 +151,20 @@ void cmdPipelineBarrier(VkCommandBuffer cmd, const std::vector<VkImageMemoryBarr
                         VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                         VkDependencyFlags dependencyFlags = 0);
 
+// queue family ownership transfers. The same barriers are passed to both halves: the release is
+// recorded for a queue in srcQueueFamily and the acquire for one in dstQueueFamily, with a
+// semaphore between their submits. If the families match, the release is a normal barrier and the
+// acquire records nothing.
+void cmdReleaseOwnership(VkCommandBuffer cmd, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+                         std::vector<VkImageMemoryBarrier> img,
+                         std::vector<VkBufferMemoryBarrier> buf = {},
+                         VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+void cmdAcquireOwnership(VkCommandBuffer cmd, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+                         std::vector<VkImageMemoryBarrier> img,
+                         std::vector<VkBufferMemoryBarrier> buf = {},
+                         VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
 void cmdBindVertexBuffers(VkCommandBuffer cmd, uint32_t firstBinding,
                           std::initializer_list<VkBuffer> bufs,
                           std::initializer_list<VkDeviceSize> offsets);
@@ -274,11 +288,11 @@ struct SemaphoreCreateInfo : public VkSemaphoreCreateInfo
 
 struct FenceCreateInfo : public VkFenceCreateInfo
 {
-  FenceCreateInfo() : VkFenceCreateInfo()
+  FenceCreateInfo(VkFenceCreateFlags flags = 0) : VkFenceCreateInfo()
   {
     sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     pNext = NULL;
-    flags = 0;
+    this->flags = flags;
   }
 
   operator const VkFenceCreateInfo *() const { return this; }
@@ -355,6 +369,17 @@ struct BufferMemoryBarrier : public VkBufferMemoryBarrier
   }
 };
 
+struct MemoryBarrier : public VkMemoryBarrier
+{
+  MemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+  {
+    sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    pNext = NULL;
+    this->srcAccessMask = srcAccessMask;
+    this->dstAccessMask = dstAccessMask;
+  }
+};
+
 struct CommandBufferAllocateInfo : public VkCommandBufferAllocateInfo
 {
   CommandBufferAllocateInfo(VkCommandPool commandPool, uint32_t commandBufferCount,
@@ -370,6 +395,19 @@ struct CommandBufferAllocateInfo : public VkCommandBufferAllocateInfo
   operator const VkCommandBufferAllocateInfo *() const { return this; }
 };
 
+struct MemoryAllocateInfo : public VkMemoryAllocateInfo
+{
+  MemoryAllocateInfo(VkDeviceSize allocationSize, uint32_t memoryTypeIndex)
+  {
+    sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    pNext = NULL;
+    this->allocationSize = allocationSize;
+    this->memoryTypeIndex = memoryTypeIndex;
+  }
+
+  operator const VkMemoryAllocateInfo *() const { return this; }
+};
+
 struct ShaderModuleCreateInfo : public VkShaderModuleCreateInfo
 {
   ShaderModuleCreateInfo(const std::vector<uint32_t> &spirv)
@@ -176,15 +176,18 @@ void main()
         vkh::vertexAttr(2, 0, DefaultA2V, uv),
     };
 
-    pipeCreateInfo.stages = {
-        CompileShaderModule(common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"),
-        CompileShaderModule(common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"),
-    };
+    std::vector<VkPipelineShaderStageCreateInfo> stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+        {compute, ShaderLang::glsl, ShaderStage::comp, "main"},
+    });
+
+    pipeCreateInfo.stages = {stages[0], stages[1]};
 
     VkPipeline drawpipe = createGraphicsPipeline(pipeCreateInfo);
 
-    VkPipeline comppipe = createComputePipeline(vkh::ComputePipelineCreateInfo(
-        complayout, CompileShaderModule(compute, ShaderLang::glsl, ShaderStage::comp, "main")));
+    VkPipeline comppipe =
+        createComputePipeline(vkh::ComputePipelineCreateInfo(complayout, stages[2]));
 
     const DefaultA2V vbdata[24] = {
         // non-indexed indirect draw
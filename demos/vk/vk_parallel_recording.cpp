@@ -0,0 +1,331 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include "vk_test.h"
+
+struct VK_Parallel_Recording : VulkanGraphicsTest
+{
+  static constexpr const char *Description =
+      "Records a large number of draws split across worker threads into secondary command "
+      "buffers, and reports how recording time scales with the number of threads.";
+
+  std::string common = R"EOSHADER(
+
+#version 420 core
+
+struct v2f
+{
+	vec4 pos;
+	vec4 col;
+	vec4 uv;
+};
+
+)EOSHADER";
+
+  const std::string vertex = R"EOSHADER(
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec4 Color;
+layout(location = 2) in vec2 UV;
+
+layout(push_constant) uniform PushData
+{
+  vec4 offsetScale;
+} push;
+
+layout(location = 0) out v2f vertOut;
+
+void main()
+{
+	vertOut.pos = vec4(Position.xy*push.offsetScale.zz + push.offsetScale.xy, Position.z, 1);
+	gl_Position = vertOut.pos;
+	vertOut.col = Color;
+	vertOut.uv = vec4(UV.xy, 0, 1);
+}
+
+)EOSHADER";
+
+  const std::string pixel = R"EOSHADER(
+
+layout(location = 0) in v2f vertIn;
+
+layout(location = 0, index = 0) out vec4 Color;
+
+void main()
+{
+	Color = vertIn.col;
+}
+
+)EOSHADER";
+
+  uint32_t numThreads = 0;
+  uint32_t numDraws = 100000;
+
+  // after warming up, a few frames are recorded on one thread to get a baseline to compare against
+  const uint32_t baselineFrames = 5;
+
+  VkPipelineLayout layout;
+  VkPipeline pipe;
+  VkBuffer vb;
+
+  std::vector<VkCommandBuffer> secondaries;
+
+  // workers wait for the generation to change, record their share of the draws, and the last one
+  // to finish signals the main thread
+  std::vector<std::thread> workers;
+  std::mutex workLock;
+  std::condition_variable workReady, workDone;
+  uint32_t generation = 0;
+  uint32_t remaining = 0;
+  bool quit = false;
+
+  void RecordDraws(uint32_t chunk, uint32_t numChunks)
+  {
+    uint32_t first = uint32_t(uint64_t(numDraws) * chunk / numChunks);
+    uint32_t last = uint32_t(uint64_t(numDraws) * (chunk + 1) / numChunks);
+
+    VkCommandBuffer cmd = GetCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+    vkh::CommandBufferInheritanceInfo inherit(swapRenderPass, 0, swapFramebuffers[swapIndex]);
+
+    vkBeginCommandBuffer(
+        cmd, vkh::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                                         inherit));
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe);
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+    vkh::cmdBindVertexBuffers(cmd, 0, {vb}, {0});
+
+    // lay the draws out in a grid covering the screen
+    uint32_t gridSize = (uint32_t)ceil(sqrt((double)numDraws));
+    float scale = 2.0f / gridSize;
+
+    for(uint32_t i = first; i < last; i++)
+    {
+      Vec4f offsetScale(-1.0f + scale * (0.5f + i % gridSize),
+                        -1.0f + scale * (0.5f + i / gridSize), scale * 0.5f, 0.0f);
+
+      vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(offsetScale),
+                         &offsetScale);
+      vkCmdDraw(cmd, 3, 1, 0, 0);
+    }
+
+    vkEndCommandBuffer(cmd);
+
+    secondaries[chunk] = cmd;
+  }
+
+  void WorkerThread(uint32_t chunk)
+  {
+    uint32_t seen = 0;
+
+    std::unique_lock<std::mutex> lock(workLock);
+
+    while(true)
+    {
+      workReady.wait(lock, [this, seen]() { return quit || generation != seen; });
+
+      if(quit)
+        return;
+
+      seen = generation;
+
+      lock.unlock();
+      RecordDraws(chunk, numThreads);
+      lock.lock();
+
+      if(--remaining == 0)
+        workDone.notify_one();
+    }
+  }
+
+  // records all draws with the given number of threads, returning the time taken in milliseconds
+  double RecordFrame(uint32_t threads)
+  {
+    secondaries.resize(threads);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if(threads == 1)
+    {
+      RecordDraws(0, 1);
+    }
+    else
+    {
+      {
+        std::lock_guard<std::mutex> lock(workLock);
+        generation++;
+        remaining = threads - 1;
+      }
+
+      workReady.notify_all();
+
+      // the main thread records the first chunk itself
+      RecordDraws(0, threads);
+
+      std::unique_lock<std::mutex> lock(workLock);
+      workDone.wait(lock, [this]() { return remaining == 0; });
+    }
+
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+    return duration.count();
+  }
+
+  int main(int argc, char **argv)
+  {
+    // initialise, create window, create context, etc
+    if(!Init(argc, argv))
+      return 3;
+
+    for(int i = 0; i < argc; i++)
+    {
+      if(i + 1 < argc && !strcmp(argv[i], "--threads"))
+        numThreads = (uint32_t)atoi(argv[i + 1]);
+
+      if(i + 1 < argc && !strcmp(argv[i], "--draws"))
+        numDraws = std::max(1, atoi(argv[i + 1]));
+    }
+
+    if(numThreads == 0)
+      numThreads = std::max(1U, std::thread::hardware_concurrency());
+
+    layout = createPipelineLayout(vkh::PipelineLayoutCreateInfo(
+        {}, {vkh::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Vec4f))}));
+
+    vkh::GraphicsPipelineCreateInfo pipeCreateInfo;
+
+    pipeCreateInfo.layout = layout;
+    pipeCreateInfo.renderPass = swapRenderPass;
+
+    pipeCreateInfo.vertexInputState.vertexBindingDescriptions = {vkh::vertexBind(0, DefaultA2V)};
+    pipeCreateInfo.vertexInputState.vertexAttributeDescriptions = {
+        vkh::vertexAttr(0, 0, DefaultA2V, pos), vkh::vertexAttr(1, 0, DefaultA2V, col),
+        vkh::vertexAttr(2, 0, DefaultA2V, uv),
+    };
+
+    pipeCreateInfo.stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+    });
+
+    pipe = createGraphicsPipeline(pipeCreateInfo);
+
+    AllocatedBuffer vertbuf(
+        allocator, vkh::BufferCreateInfo(sizeof(DefaultTri), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+        VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_CPU_TO_GPU}));
+
+    vertbuf.upload(DefaultTri);
+
+    vb = vertbuf.buffer;
+
+    for(uint32_t i = 1; i < numThreads; i++)
+      workers.push_back(std::thread(&VK_Parallel_Recording::WorkerThread, this, i));
+
+    // always skip at least the first frame, which pays for cold caches and first-time allocations
+    const uint32_t skipFrames = (uint32_t)std::max(1, warmupFrames);
+
+    double baseline = 0.0;
+    uint32_t frame = 0;
+
+    while(Running())
+    {
+      bool isWarmup = frame < skipFrames;
+      bool isBaseline = !isWarmup && frame < skipFrames + baselineFrames;
+
+      double recordTime = RecordFrame(isWarmup || isBaseline ? 1 : numThreads);
+
+      if(isWarmup)
+      {
+        TEST_LOG("Frame %u: recorded %u draws on 1 thread in %.2f ms (warmup)", frame, numDraws,
+                 recordTime);
+      }
+      else if(isBaseline)
+      {
+        baseline += recordTime / baselineFrames;
+
+        TEST_LOG("Frame %u: recorded %u draws on 1 thread in %.2f ms (baseline)", frame, numDraws,
+                 recordTime);
+      }
+      else
+      {
+        // 100% means N threads record N times faster than one
+        double efficiency = 100.0 * baseline / (recordTime * numThreads);
+
+        TEST_LOG("Frame %u: recorded %u draws on %u threads in %.2f ms, %.1fx speedup, %.0f%% "
+                 "scaling efficiency",
+                 frame, numDraws, numThreads, recordTime, baseline / recordTime, efficiency);
+      }
+
+      frame++;
+
+      VkCommandBuffer cmd = GetCommandBuffer();
+
+      vkBeginCommandBuffer(cmd, vkh::CommandBufferBeginInfo());
+
+      VkImage swapimg =
+          StartUsingBackbuffer(cmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+      vkCmdClearColorImage(cmd, swapimg, VK_IMAGE_LAYOUT_GENERAL,
+                           vkh::ClearColorValue(0.4f, 0.5f, 0.6f, 1.0f), 1,
+                           vkh::ImageSubresourceRange());
+
+      vkCmdBeginRenderPass(
+          cmd, vkh::RenderPassBeginInfo(swapRenderPass, swapFramebuffers[swapIndex], scissor),
+          VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+      vkCmdExecuteCommands(cmd, (uint32_t)secondaries.size(), secondaries.data());
+
+      vkCmdEndRenderPass(cmd);
+
+      FinishUsingBackbuffer(cmd, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+      vkEndCommandBuffer(cmd);
+
+      Submit(0, 1, {cmd});
+
+      Present();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(workLock);
+      quit = true;
+    }
+
+    workReady.notify_all();
+
+    for(std::thread &t : workers)
+      t.join();
+
+    return 0;
+  }
+};
+
+REGISTER_TEST(VK_Parallel_Recording);
@@ -0,0 +1,272 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+
+#include <math.h>
+#include "vk_test.h"
+
+struct VK_Queue_Ownership : VulkanGraphicsTest
+{
+  static constexpr const char *Description =
+      "Writes a vertex buffer on the compute queue each frame and draws it on the graphics queue, "
+      "transferring ownership of the exclusive buffer between the queue families both ways.";
+
+  std::string common = R"EOSHADER(
+
+#version 420 core
+
+struct v2f
+{
+	vec4 pos;
+	vec4 col;
+	vec4 uv;
+};
+
+)EOSHADER";
+
+  const std::string vertex = R"EOSHADER(
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec4 Color;
+layout(location = 2) in vec2 UV;
+
+layout(location = 0) out v2f vertOut;
+
+void main()
+{
+	vertOut.pos = vec4(Position.xyz, 1);
+	gl_Position = vertOut.pos;
+	vertOut.col = Color;
+	vertOut.uv = vec4(UV.xy, 0, 1);
+}
+
+)EOSHADER";
+
+  const std::string pixel = R"EOSHADER(
+
+layout(location = 0) in v2f vertIn;
+
+layout(location = 0, index = 0) out vec4 Color;
+
+void main()
+{
+	Color = vertIn.col;
+}
+
+)EOSHADER";
+
+  const std::string compute = R"EOSHADER(
+
+#version 430 core
+
+layout (local_size_x = 3, local_size_y = 1, local_size_z = 1) in;
+
+layout(push_constant) uniform PushConstants {
+	float angle;
+} push;
+
+// tightly packed DefaultA2V vertices: vec3 pos, vec4 col, vec2 uv
+layout(binding = 0, std430) buffer vertex_buffer
+{
+	float data[];
+} vb;
+
+void main()
+{
+  uint idx = gl_GlobalInvocationID.x;
+  uint base = idx * 9;
+
+  float a = push.angle + float(idx) * 2.0943951;
+
+  vb.data[base + 0] = 0.5f * sin(a);
+  vb.data[base + 1] = -0.5f * cos(a);
+  vb.data[base + 2] = 0.0f;
+
+  vb.data[base + 3] = idx == 0 ? 1.0f : 0.0f;
+  vb.data[base + 4] = idx == 1 ? 1.0f : 0.0f;
+  vb.data[base + 5] = idx == 2 ? 1.0f : 0.0f;
+  vb.data[base + 6] = 1.0f;
+
+  vb.data[base + 7] = idx == 1 ? 1.0f : 0.0f;
+  vb.data[base + 8] = idx == 2 ? 1.0f : 0.0f;
+}
+
+)EOSHADER";
+
+  int main(int argc, char **argv)
+  {
+    wantComputeQueue = true;
+
+    // initialise, create window, create context, etc
+    if(!Init(argc, argv))
+      return 3;
+
+    if(computeQueueFamilyIndex == queueFamilyIndex)
+      TEST_LOG("No separate compute queue family, ownership transfers are plain barriers");
+
+    VkDescriptorSetLayout setlayout = createDescriptorSetLayout(vkh::DescriptorSetLayoutCreateInfo({
+        {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT},
+    }));
+
+    VkPipelineLayout complayout = createPipelineLayout(vkh::PipelineLayoutCreateInfo(
+        {setlayout}, {vkh::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float))}));
+
+    VkPipelineLayout drawlayout = createPipelineLayout(vkh::PipelineLayoutCreateInfo());
+
+    vkh::GraphicsPipelineCreateInfo pipeCreateInfo;
+
+    pipeCreateInfo.layout = drawlayout;
+    pipeCreateInfo.renderPass = swapRenderPass;
+
+    pipeCreateInfo.vertexInputState.vertexBindingDescriptions = {vkh::vertexBind(0, DefaultA2V)};
+    pipeCreateInfo.vertexInputState.vertexAttributeDescriptions = {
+        vkh::vertexAttr(0, 0, DefaultA2V, pos), vkh::vertexAttr(1, 0, DefaultA2V, col),
+        vkh::vertexAttr(2, 0, DefaultA2V, uv),
+    };
+
+    std::vector<VkPipelineShaderStageCreateInfo> stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+        {compute, ShaderLang::glsl, ShaderStage::comp, "main"},
+    });
+
+    pipeCreateInfo.stages = {stages[0], stages[1]};
+
+    VkPipeline drawpipe = createGraphicsPipeline(pipeCreateInfo);
+
+    VkPipeline comppipe =
+        createComputePipeline(vkh::ComputePipelineCreateInfo(complayout, stages[2]));
+
+    // the buffer is exclusive, so each queue family has to acquire it before using it
+    AllocatedBuffer vb(allocator,
+                       vkh::BufferCreateInfo(sizeof(DefaultTri),
+                                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+                       VmaAllocationCreateInfo({0, VMA_MEMORY_USAGE_GPU_ONLY}));
+
+    VkDescriptorSet descset = allocateDescriptorSet(setlayout);
+
+    vkh::updateDescriptorSets(
+        device, {
+                    vkh::WriteDescriptorSet(descset, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            {vkh::DescriptorBufferInfo(vb.buffer)}),
+                });
+
+    // the compute and graphics submits alternate, each waiting for the other's release
+    VkSemaphore computeDone = createSemaphore();
+    VkSemaphore renderDone = createSemaphore();
+
+    bool firstFrame = true;
+    float angle = 0.0f;
+
+    while(Running())
+    {
+      VkCommandBuffer cmd =
+          GetCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, computeQueueFamilyIndex);
+
+      vkBeginCommandBuffer(cmd, vkh::CommandBufferBeginInfo());
+
+      // on the first frame the buffer hasn't been used yet, so there's nothing to acquire
+      if(!firstFrame)
+        vkh::cmdAcquireOwnership(
+            cmd, queueFamilyIndex, computeQueueFamilyIndex, {},
+            {vkh::BufferMemoryBarrier(VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                                      VK_ACCESS_SHADER_WRITE_BIT, vb.buffer)},
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, comppipe);
+      vkh::cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, complayout, 0, {descset},
+                                 {});
+      vkCmdPushConstants(cmd, complayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(angle), &angle);
+      vkCmdDispatch(cmd, 1, 1, 1);
+
+      vkh::cmdReleaseOwnership(cmd, computeQueueFamilyIndex, queueFamilyIndex, {},
+                               {vkh::BufferMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT,
+                                                         VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                                                         vb.buffer)},
+                               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+      vkEndCommandBuffer(cmd);
+
+      if(firstFrame)
+        SubmitToQueue(computeQueue, {cmd}, {}, {computeDone});
+      else
+        SubmitToQueue(computeQueue, {cmd}, {renderDone}, {computeDone});
+
+      cmd = GetCommandBuffer();
+
+      vkBeginCommandBuffer(cmd, vkh::CommandBufferBeginInfo());
+
+      vkh::cmdAcquireOwnership(cmd, computeQueueFamilyIndex, queueFamilyIndex, {},
+                               {vkh::BufferMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT,
+                                                         VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                                                         vb.buffer)},
+                               VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+      VkImage swapimg =
+          StartUsingBackbuffer(cmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+      vkCmdClearColorImage(cmd, swapimg, VK_IMAGE_LAYOUT_GENERAL,
+                           vkh::ClearColorValue(0.4f, 0.5f, 0.6f, 1.0f), 1,
+                           vkh::ImageSubresourceRange());
+
+      vkCmdBeginRenderPass(
+          cmd, vkh::RenderPassBeginInfo(swapRenderPass, swapFramebuffers[swapIndex], scissor),
+          VK_SUBPASS_CONTENTS_INLINE);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, drawpipe);
+      vkCmdSetViewport(cmd, 0, 1, &viewport);
+      vkCmdSetScissor(cmd, 0, 1, &scissor);
+      vkh::cmdBindVertexBuffers(cmd, 0, {vb.buffer}, {0});
+      vkCmdDraw(cmd, 3, 1, 0, 0);
+
+      vkCmdEndRenderPass(cmd);
+
+      // hand the buffer back so the next frame's dispatch can write to it
+      vkh::cmdReleaseOwnership(cmd, queueFamilyIndex, computeQueueFamilyIndex, {},
+                               {vkh::BufferMemoryBarrier(VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                                                         VK_ACCESS_SHADER_WRITE_BIT, vb.buffer)},
+                               VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+      FinishUsingBackbuffer(cmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+      vkEndCommandBuffer(cmd);
+
+      Submit(0, 1, {cmd}, {computeDone}, {renderDone});
+
+      Present();
+
+      firstFrame = false;
+      angle += 0.01f;
+    }
+
+    // nothing waits on the last frame's renderDone, so let both queues finish before it's destroyed
+    CHECK_VKR(vkQueueWaitIdle(computeQueue));
+    CHECK_VKR(vkQueueWaitIdle(queue));
+
+    return 0;
+  }
+};
+
+REGISTER_TEST(VK_Queue_Ownership);
@@ -121,10 +121,10 @@ void main()
         vkh::vertexAttr(2, 0, DefaultA2V, uv),
     };
 
-    pipeCreateInfo.stages = {
-        CompileShaderModule(common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"),
-        CompileShaderModule(common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"),
-    };
+    pipeCreateInfo.stages = CompileShaderModules({
+        {common + vertex, ShaderLang::glsl, ShaderStage::vert, "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+    });
 
     pipeCreateInfo.subpass = 0;
     VkPipeline pipe0 = createGraphicsPipeline(pipeCreateInfo);
@@ -229,7 +229,7 @@ void main()
 
       vkEndCommandBuffer(cmd);
 
-      Submit(0, 1, {cmd}, {cmd2});
+      Submit(0, 1, {cmd});
 
       Present();
     }
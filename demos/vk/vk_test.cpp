@@ -55,6 +55,190 @@ static VkBool32 VKAPI_PTR vulkanCallback(VkDebugReportFlagsEXT flags,
   return false;
 }
 
+// describes everything that changes which ICDs and layers the loader will find. Empty if that
+// can't be determined cheaply, in which case nothing is cached
+static std::string GetVulkanLoaderIdentity()
+{
+#if defined(WIN32)
+  // drivers and layers are registered in the registry, which we don't try to track
+  return "";
+#else
+  std::string ret = "loader " + std::to_string(volkGetInstanceVersion());
+
+  for(const char *var : {"VK_ICD_FILENAMES", "VK_DRIVER_FILES", "VK_ADD_DRIVER_FILES",
+                         "VK_LAYER_PATH", "VK_ADD_LAYER_PATH", "VK_INSTANCE_LAYERS",
+                         "XDG_DATA_DIRS", "XDG_CONFIG_DIRS"})
+  {
+    const char *val = getenv(var);
+    if(val)
+      ret += std::string(" ") + var + "=" + val;
+  }
+
+  std::vector<std::string> roots = {"/etc/vulkan", "/usr/share/vulkan", "/usr/local/share/vulkan"};
+
+  const char *home = getenv("HOME");
+  if(home && home[0])
+    roots.push_back(std::string(home) + "/.local/share/vulkan");
+
+  // manifests are added and removed when drivers or layers are (un)installed, which changes the
+  // modification time of the directory they're in
+  for(const std::string &root : roots)
+  {
+    for(const char *dir : {"/icd.d", "/implicit_layer.d", "/explicit_layer.d"})
+    {
+      uint64_t size = 0, modified = 0;
+      if(GetFileStamp(root + dir, size, modified))
+        ret += " " + root + dir + "@" + std::to_string(modified);
+    }
+  }
+
+  return ret;
+#endif
+}
+
+static std::vector<std::string> SplitNames(const std::string &names)
+{
+  std::vector<std::string> ret;
+
+  size_t start = 0;
+  while(start < names.size())
+  {
+    size_t end = names.find(' ', start);
+    if(end == std::string::npos)
+      end = names.size();
+
+    if(end > start)
+      ret.push_back(names.substr(start, end - start));
+
+    start = end + 1;
+  }
+
+  return ret;
+}
+
+// enumerate the instance layers and extensions, or fetch them from the capability cache if the
+// loader should still find the same ones. Returns true if they came from the cache
+static bool GetInstanceCapabilities(std::vector<VkLayerProperties> &layers,
+                                    std::vector<VkExtensionProperties> &exts)
+{
+  std::string identity = GetVulkanLoaderIdentity();
+  std::string layerNames, extNames;
+
+  if(!identity.empty() && GetCachedCapability("vk_instance_layers", identity, layerNames) &&
+     GetCachedCapability("vk_instance_extensions", identity, extNames))
+  {
+    // we only ever look at the names
+    for(const std::string &name : SplitNames(layerNames))
+    {
+      VkLayerProperties layer = {};
+      strncpy(layer.layerName, name.c_str(), VK_MAX_EXTENSION_NAME_SIZE - 1);
+      layers.push_back(layer);
+    }
+
+    for(const std::string &name : SplitNames(extNames))
+    {
+      VkExtensionProperties ext = {};
+      strncpy(ext.extensionName, name.c_str(), VK_MAX_EXTENSION_NAME_SIZE - 1);
+      exts.push_back(ext);
+    }
+
+    return true;
+  }
+
+  CHECK_VKR(vkh::enumerateInstanceLayerProperties(layers));
+  CHECK_VKR(vkh::enumerateInstanceExtensionProperties(exts, NULL));
+
+  if(!identity.empty())
+  {
+    layerNames.clear();
+    for(const VkLayerProperties &layer : layers)
+      layerNames += std::string(layer.layerName) + " ";
+
+    extNames.clear();
+    for(const VkExtensionProperties &ext : exts)
+      extNames += std::string(ext.extensionName) + " ";
+
+    SetCachedCapability("vk_instance_layers", identity, layerNames);
+    SetCachedCapability("vk_instance_extensions", identity, extNames);
+  }
+
+  return false;
+}
+
+static void ForgetInstanceCapabilities()
+{
+  ForgetCachedCapability("vk_instance_layers");
+  ForgetCachedCapability("vk_instance_extensions");
+}
+
+static void WritePipelineCache(VkDevice device, VkPipelineCache cache, const std::string &path)
+{
+  size_t size = 0;
+  if(vkGetPipelineCacheData(device, cache, &size, NULL) != VK_SUCCESS || size == 0)
+    return;
+
+  std::vector<byte> data(size);
+  if(vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  if(!WriteFileAtomically(path, data.data(), size))
+    TEST_WARN("Couldn't write pipeline cache '%s'", path.c_str());
+}
+
+// the core objects a test hands on to the next one when resources are shared between tests
+struct SharedVulkanDevice
+{
+  std::string key;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  VkDebugReportCallbackEXT debugReportCallback = VK_NULL_HANDLE;
+  VkPhysicalDevice phys = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+
+  std::vector<const char *> instExts;
+  std::vector<const char *> devExts;
+
+  uint32_t queueFamilyIndex = ~0U;
+  VkQueue queue = VK_NULL_HANDLE;
+  uint32_t transferQueueFamilyIndex = ~0U;
+  VkQueue transferQueue = VK_NULL_HANDLE;
+  uint32_t computeQueueFamilyIndex = ~0U;
+  VkQueue computeQueue = VK_NULL_HANDLE;
+
+  VmaAllocator allocator = VK_NULL_HANDLE;
+
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  std::string pipelineCachePath;
+};
+
+static SharedVulkanDevice sharedDevice;
+
+static void ReleaseSharedDevice()
+{
+  if(sharedDevice.device == VK_NULL_HANDLE)
+    return;
+
+  vmaDestroyAllocator(sharedDevice.allocator);
+
+  if(sharedDevice.pipelineCache != VK_NULL_HANDLE)
+  {
+    if(!sharedDevice.pipelineCachePath.empty())
+      WritePipelineCache(sharedDevice.device, sharedDevice.pipelineCache,
+                         sharedDevice.pipelineCachePath);
+
+    vkDestroyPipelineCache(sharedDevice.device, sharedDevice.pipelineCache, NULL);
+  }
+
+  vkDestroyDevice(sharedDevice.device, NULL);
+
+  if(sharedDevice.debugReportCallback)
+    vkDestroyDebugReportCallbackEXT(sharedDevice.instance, sharedDevice.debugReportCallback, NULL);
+
+  vkDestroyInstance(sharedDevice.instance, NULL);
+
+  sharedDevice = SharedVulkanDevice();
+}
+
 VulkanGraphicsTest::VulkanGraphicsTest()
 {
   features.depthClamp = true;
@@ -62,40 +246,215 @@ VulkanGraphicsTest::VulkanGraphicsTest()
 
 bool VulkanGraphicsTest::Init(int argc, char **argv)
 {
+  PROFILE_ZONE("VulkanGraphicsTest::Init");
+
   // parse parameters here to override parameters
   GraphicsTest::Init(argc, argv);
 
-  if(volkInitialize() != VK_SUCCESS)
+  for(int i = 0; i < argc; i++)
   {
-    TEST_ERROR("Couldn't init vulkan");
-    return false;
+    if(!strcmp(argv[i], "--no-pipeline-cache"))
+    {
+      pipelineCacheEnabled = false;
+    }
+
+    if(i + 1 < argc && !strcmp(argv[i], "--frames-in-flight"))
+    {
+      framesInFlight = (uint32_t)std::max(1, atoi(argv[i + 1]));
+    }
+
+    if(!strcmp(argv[i], "--gpu-timestamps"))
+    {
+      gpuTimestamps = true;
+    }
+
+    if(i + 1 < argc && !strcmp(argv[i], "--gpu-timestamps-json"))
+    {
+      gpuTimestamps = true;
+      gpuTimestampsJson = argv[i + 1];
+    }
+  }
+
+  {
+    PROFILE_ZONE("volkInitialize");
+
+    if(volkInitialize() != VK_SUCCESS)
+    {
+      TEST_ERROR("Couldn't init vulkan");
+      return false;
+    }
   }
 
-  if(!SpvCompilationSupported())
+  if(!SpvCompilationSupported() && !HavePrecompiledSpv())
   {
     TEST_ERROR("glslc must be in PATH to run vulkan tests");
     return false;
   }
 
-  instExts.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+  if(!headless)
+  {
+    instExts.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 
 #if defined(WIN32)
-  instExts.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+    instExts.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #else
-  instExts.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
+    instExts.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
 
-  X11Window::Init();
+    X11Window::Init();
 #endif
+  }
 
   if(debugDevice)
     instExts.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 
   optInstExts.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
+  if(!headless)
+    devExts.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  // in --run-many mode the device from a previous test is reused if it was created the same way
+  deviceKey = getDeviceKey();
+
+  if(!adoptSharedDevice() && !createDevice())
+    return false;
+
+  if(!headless)
+  {
+    mainWindow = MakeWindow(screenWidth, screenHeight, "Autotesting");
+
+    VkResult vkr = (VkResult)CreateSurface(mainWindow, &surface);
+
+    if(vkr != VK_SUCCESS)
+    {
+      TEST_ERROR("Error creating surface: %s", vkh::result_str(vkr));
+      return false;
+    };
+  }
+
+  for(VkQueue q : {queue, transferQueue, computeQueue})
+  {
+    if(std::find(queues.begin(), queues.end(), q) == queues.end())
+      queues.push_back(q);
+  }
+
+  if(pipelineCache == VK_NULL_HANDLE && !loadPipelineCache())
+    return false;
+
+  if(gpuTimestamps)
+  {
+    std::vector<VkQueueFamilyProperties> queueProps;
+    vkh::getQueueFamilyProperties(queueProps, phys);
+
+    uint32_t validBits = queueProps[queueFamilyIndex].timestampValidBits;
+
+    if(validBits == 0)
+    {
+      TEST_WARN("Timestamps aren't supported on the graphics queue, ignoring --gpu-timestamps");
+      gpuTimestamps = false;
+    }
+    else
+    {
+      VkPhysicalDeviceProperties props;
+      vkGetPhysicalDeviceProperties(phys, &props);
+
+      timestampPeriod = props.limits.timestampPeriod;
+      timestampMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+    }
+  }
+
+  frames.resize(framesInFlight);
+  for(FrameData &frame : frames)
+  {
+    CHECK_VKR(
+        vkCreateSemaphore(device, vkh::SemaphoreCreateInfo(), NULL, &frame.renderStartSemaphore));
+    CHECK_VKR(
+        vkCreateSemaphore(device, vkh::SemaphoreCreateInfo(), NULL, &frame.renderEndSemaphore));
+
+    // created signalled, since no frame has been submitted yet that we need to wait for
+    frame.fences.resize(queues.size());
+    for(VkFence &fence : frame.fences)
+      CHECK_VKR(vkCreateFence(device, vkh::FenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT), NULL,
+                              &fence));
+
+    if(gpuTimestamps)
+    {
+      VkQueryPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+      poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      poolInfo.queryCount = maxTimestampQueries;
+
+      CHECK_VKR(vkCreateQueryPool(device, &poolInfo, NULL, &frame.queryPool));
+    }
+  }
+
+  // the first frame's queries are reset here, later frames' in Present()
+  if(gpuTimestamps)
+    resetTimestampQueries();
+
+  // each frame in flight needs its own backbuffer to render to
+  headlessImageCount = std::max(headlessImageCount, framesInFlight);
+
+  {
+    PROFILE_ZONE("Backbuffer creation");
+
+    if(headless)
+      createHeadlessImages();
+    else
+      createSwap();
+  }
+
+  {
+    PROFILE_ZONE("First acquireImage");
+
+    acquireImage();
+  }
+
+  // a shared device brings its allocator with it
+  if(allocator != VK_NULL_HANDLE)
+    return true;
+
+  VmaVulkanFunctions funcs = {
+      vkGetPhysicalDeviceProperties,
+      vkGetPhysicalDeviceMemoryProperties,
+      vkAllocateMemory,
+      vkFreeMemory,
+      vkMapMemory,
+      vkUnmapMemory,
+      vkFlushMappedMemoryRanges,
+      vkInvalidateMappedMemoryRanges,
+      vkBindBufferMemory,
+      vkBindImageMemory,
+      vkGetBufferMemoryRequirements,
+      vkGetImageMemoryRequirements,
+      vkCreateBuffer,
+      vkDestroyBuffer,
+      vkCreateImage,
+      vkDestroyImage,
+      vkGetBufferMemoryRequirements2KHR,
+      vkGetImageMemoryRequirements2KHR,
+  };
+
+  VmaAllocatorCreateInfo allocInfo = {};
+  allocInfo.physicalDevice = phys;
+  allocInfo.device = device;
+  allocInfo.frameInUseCount = uint32_t(swapImages.size() - 1);
+  allocInfo.pVulkanFunctions = &funcs;
+
+  {
+    PROFILE_ZONE("vmaCreateAllocator");
+
+    vmaCreateAllocator(&allocInfo, &allocator);
+  }
+
+  return true;
+}
+
+bool VulkanGraphicsTest::createDevice()
+{
   std::vector<const char *> layers;
 
   std::vector<VkLayerProperties> supportedLayers;
-  CHECK_VKR(vkh::enumerateInstanceLayerProperties(supportedLayers));
+  std::vector<VkExtensionProperties> supportedExts;
+  bool cachedCaps = GetInstanceCapabilities(supportedLayers, supportedExts);
 
   if(debugDevice)
   {
@@ -109,9 +468,6 @@ bool VulkanGraphicsTest::Init(int argc, char **argv)
     }
   }
 
-  std::vector<VkExtensionProperties> supportedExts;
-  CHECK_VKR(vkh::enumerateInstanceExtensionProperties(supportedExts, NULL));
-
   for(const char *search : instExts)
   {
     bool found = false;
@@ -126,6 +482,9 @@ bool VulkanGraphicsTest::Init(int argc, char **argv)
 
     if(!found)
     {
+      if(cachedCaps)
+        ForgetInstanceCapabilities();
+
       TEST_ERROR("Required instance extension '%s' missing", search);
       return false;
     }
@@ -151,9 +510,20 @@ bool VulkanGraphicsTest::Init(int argc, char **argv)
   vkh::ApplicationInfo app("RenderDoc autotesting", VK_MAKE_VERSION(1, 0, 0),
                            "RenderDoc autotesting", VK_MAKE_VERSION(1, 0, 0), VK_API_VERSION_1_0);
 
-  CHECK_VKR(vkCreateInstance(vkh::InstanceCreateInfo(app, layers, instExts), NULL, &instance));
+  {
+    PROFILE_ZONE("vkCreateInstance");
+
+    VkResult vkr =
+        vkCreateInstance(vkh::InstanceCreateInfo(app, layers, instExts), NULL, &instance);
+
+    // if the cached capabilities were out of date, don't use them next time
+    if(vkr != VK_SUCCESS && cachedCaps)
+      ForgetInstanceCapabilities();
+
+    CHECK_VKR(vkr);
 
-  volkLoadInstance((VkInstance)instance);
+    volkLoadInstance((VkInstance)instance);
+  }
 
   if(debugDevice)
   {
@@ -196,17 +566,50 @@ bool VulkanGraphicsTest::Init(int argc, char **argv)
     return false;
   }
 
-  mainWindow = MakeWindow(screenWidth, screenHeight, "Autotesting");
+  // look for a family with the flags we want and none that we don't, so that it's separate from
+  // the graphics family
+  auto findFamily = [&queueProps](VkQueueFlags want, VkQueueFlags avoid) {
+    for(uint32_t q = 0; q < queueProps.size(); q++)
+    {
+      VkQueueFlags flags = queueProps[q].queueFlags;
+      if((flags & want) == want && (flags & avoid) == 0 && queueProps[q].queueCount > 0)
+        return q;
+    }
+    return ~0U;
+  };
 
-  VkResult vkr = (VkResult)CreateSurface(mainWindow, &surface);
+  transferQueueFamilyIndex = computeQueueFamilyIndex = queueFamilyIndex;
 
-  if(vkr != VK_SUCCESS)
+  if(wantTransferQueue)
   {
-    TEST_ERROR("Error creating surface: %s", vkh::result_str(vkr));
-    return false;
+    // prefer a transfer-only family, but a compute family can still transfer separately
+    uint32_t family =
+        findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if(family == ~0U)
+      family = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if(family != ~0U)
+      transferQueueFamilyIndex = family;
+  }
+
+  if(wantComputeQueue)
+  {
+    uint32_t family = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if(family != ~0U)
+      computeQueueFamilyIndex = family;
+  }
+
+  // give each requested queue its own queue within the family where there are enough, otherwise
+  // they share the family's last queue
+  std::vector<uint32_t> queueCounts(queueProps.size());
+  auto addQueue = [&queueCounts, &queueProps](uint32_t family, bool want) {
+    uint32_t idx = want ? std::min(queueCounts[family], queueProps[family].queueCount - 1) : 0;
+    queueCounts[family] = std::max(queueCounts[family], idx + 1);
+    return idx;
   };
 
-  devExts.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  uint32_t queueIndex = addQueue(queueFamilyIndex, true);
+  uint32_t transferQueueIndex = addQueue(transferQueueFamilyIndex, wantTransferQueue);
+  uint32_t computeQueueIndex = addQueue(computeQueueFamilyIndex, wantComputeQueue);
 
   VkPhysicalDeviceFeatures supported;
   vkGetPhysicalDeviceFeatures(phys, &supported);
@@ -286,56 +689,51 @@ bool VulkanGraphicsTest::Init(int argc, char **argv)
       devExts.push_back(search);
   }
 
-  CHECK_VKR(vkCreateDevice(phys,
-                           vkh::DeviceCreateInfo({vkh::DeviceQueueCreateInfo(queueFamilyIndex, 1)},
-                                                 layers, devExts, features),
-                           NULL, &device));
+  std::vector<float> priorities(*std::max_element(queueCounts.begin(), queueCounts.end()), 1.0f);
 
-  volkLoadDevice(device);
+  std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+  for(uint32_t q = 0; q < queueCounts.size(); q++)
+  {
+    if(queueCounts[q] > 0)
+      queueCreateInfos.push_back(vkh::DeviceQueueCreateInfo(q, queueCounts[q], priorities));
+  }
 
-  vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+  {
+    PROFILE_ZONE("vkCreateDevice");
 
-  CHECK_VKR(vkCreateSemaphore(device, vkh::SemaphoreCreateInfo(), NULL, &renderStartSemaphore));
-  CHECK_VKR(vkCreateSemaphore(device, vkh::SemaphoreCreateInfo(), NULL, &renderEndSemaphore));
+    CHECK_VKR(vkCreateDevice(
+        phys, vkh::DeviceCreateInfo(queueCreateInfos, layers, devExts, features), NULL, &device));
 
-  CHECK_VKR(vkCreateCommandPool(
-      device, vkh::CommandPoolCreateInfo(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT), NULL,
-      &cmdPool));
+    volkLoadDevice(device);
+  }
 
-  createSwap();
+  vkGetDeviceQueue(device, queueFamilyIndex, queueIndex, &queue);
+  vkGetDeviceQueue(device, transferQueueFamilyIndex, transferQueueIndex, &transferQueue);
+  vkGetDeviceQueue(device, computeQueueFamilyIndex, computeQueueIndex, &computeQueue);
 
-  acquireImage();
+  return true;
+}
 
-  VmaVulkanFunctions funcs = {
-      vkGetPhysicalDeviceProperties,
-      vkGetPhysicalDeviceMemoryProperties,
-      vkAllocateMemory,
-      vkFreeMemory,
-      vkMapMemory,
-      vkUnmapMemory,
-      vkFlushMappedMemoryRanges,
-      vkInvalidateMappedMemoryRanges,
-      vkBindBufferMemory,
-      vkBindImageMemory,
-      vkGetBufferMemoryRequirements,
-      vkGetImageMemoryRequirements,
-      vkCreateBuffer,
-      vkDestroyBuffer,
-      vkCreateImage,
-      vkDestroyImage,
-      vkGetBufferMemoryRequirements2KHR,
-      vkGetImageMemoryRequirements2KHR,
-  };
+std::string VulkanGraphicsTest::getDeviceKey()
+{
+  std::string key = std::to_string(headless) + std::to_string(debugDevice) +
+                    std::to_string(wantTransferQueue) + std::to_string(wantComputeQueue) +
+                    std::to_string(pipelineCacheEnabled);
 
-  VmaAllocatorCreateInfo allocInfo = {};
-  allocInfo.physicalDevice = phys;
-  allocInfo.device = device;
-  allocInfo.frameInUseCount = uint32_t(swapImages.size() - 1);
-  allocInfo.pVulkanFunctions = &funcs;
+  for(const std::vector<const char *> *exts : {&instExts, &optInstExts, &devExts, &optDevExts})
+  {
+    key += "|";
+    for(const char *ext : *exts)
+      key += std::string(ext) + " ";
+  }
 
-  vmaCreateAllocator(&allocInfo, &allocator);
+  key += "|";
 
-  return true;
+  const VkBool32 *feature = (const VkBool32 *)&features;
+  for(size_t i = 0; i < sizeof(features) / sizeof(VkBool32); i++)
+    key += feature[i] ? '1' : '0';
+
+  return key;
 }
 
 bool VulkanGraphicsTest::IsSupported()
@@ -343,47 +741,252 @@ bool VulkanGraphicsTest::IsSupported()
   if(volkGetInstanceVersion() > 0)
     return true;
 
-  static bool glslcChecked = false;
-
-  if(!glslcChecked)
-  {
-    static bool glslcSupported = SpvCompilationSupported();
+  static bool glslcSupported = SpvCompilationSupported() || HavePrecompiledSpv();
 
-    if(!glslcSupported)
-      return false;
-  }
+  if(!glslcSupported)
+    return false;
 
   return volkInitialize() == VK_SUCCESS;
 }
 
-GraphicsWindow *VulkanGraphicsTest::MakeWindow(int width, int height, const char *title)
+bool VulkanGraphicsTest::adoptSharedDevice()
 {
-#if defined(WIN32)
-  return new Win32Window(width, height, title);
-#else
-  return new X11Window(width, height, title);
-#endif
-}
+  if(sharedDevice.device == VK_NULL_HANDLE)
+    return false;
+
+  // a device set up differently can't be used, and won't be wanted again while it's incompatible
+  if(sharedDevice.key != deviceKey)
+  {
+    ReleaseSharedDevice();
+    return false;
+  }
+
+  instance = sharedDevice.instance;
+  debugReportCallback = sharedDevice.debugReportCallback;
+  phys = sharedDevice.phys;
+  device = sharedDevice.device;
+
+  instExts = sharedDevice.instExts;
+  devExts = sharedDevice.devExts;
+
+  queueFamilyIndex = sharedDevice.queueFamilyIndex;
+  queue = sharedDevice.queue;
+  transferQueueFamilyIndex = sharedDevice.transferQueueFamilyIndex;
+  transferQueue = sharedDevice.transferQueue;
+  computeQueueFamilyIndex = sharedDevice.computeQueueFamilyIndex;
+  computeQueue = sharedDevice.computeQueue;
+
+  allocator = sharedDevice.allocator;
+
+  pipelineCache = sharedDevice.pipelineCache;
+  pipelineCachePath = sharedDevice.pipelineCachePath;
+
+  // this test owns them now, until it shares them again
+  sharedDevice = SharedVulkanDevice();
+
+  return true;
+}
+
+void VulkanGraphicsTest::shareDevice()
+{
+  static bool registered = false;
+
+  if(!registered)
+  {
+    AddSharedRelease(&ReleaseSharedDevice);
+    registered = true;
+  }
+
+  sharedDevice.key = deviceKey;
+
+  sharedDevice.instance = instance;
+  sharedDevice.debugReportCallback = debugReportCallback;
+  sharedDevice.phys = phys;
+  sharedDevice.device = device;
+
+  sharedDevice.instExts = instExts;
+  sharedDevice.devExts = devExts;
+
+  sharedDevice.queueFamilyIndex = queueFamilyIndex;
+  sharedDevice.queue = queue;
+  sharedDevice.transferQueueFamilyIndex = transferQueueFamilyIndex;
+  sharedDevice.transferQueue = transferQueue;
+  sharedDevice.computeQueueFamilyIndex = computeQueueFamilyIndex;
+  sharedDevice.computeQueue = computeQueue;
+
+  sharedDevice.allocator = allocator;
+
+  sharedDevice.pipelineCache = pipelineCache;
+  sharedDevice.pipelineCachePath = pipelineCacheEnabled ? pipelineCachePath : "";
+}
+
+bool VulkanGraphicsTest::loadPipelineCache()
+{
+  PROFILE_ZONE("loadPipelineCache");
+
+  // with the cache disabled pipelines are created with no cache at all, not an empty one
+  if(!pipelineCacheEnabled)
+    return true;
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(phys, &props);
+
+  // the cache UUID alone should identify compatible data, but include the device and driver
+  // version so that driver updates don't keep overwriting each other's caches
+  char filename[VK_UUID_SIZE * 2 + 64] = {};
+  char *c = filename;
+  for(uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    c += sprintf(c, "%02x", props.pipelineCacheUUID[i]);
+  snprintf(c, sizeof(filename) - (c - filename) - 1, "_%04x_%04x_%08x.bin", props.vendorID,
+           props.deviceID, props.driverVersion);
+
+  pipelineCachePath = GetCacheDir() + "/vkpipelines/" + filename;
+
+  std::vector<byte> initialData;
+
+  if(ReadFileData(pipelineCachePath, initialData))
+  {
+    // validate the header ourselves rather than relying on every driver to reject bad data
+    struct
+    {
+      uint32_t length;
+      uint32_t version;
+      uint32_t vendorID;
+      uint32_t deviceID;
+      uint8_t uuid[VK_UUID_SIZE];
+    } header;
+
+    bool valid = initialData.size() >= sizeof(header);
+
+    if(valid)
+    {
+      memcpy(&header, initialData.data(), sizeof(header));
+
+      valid = header.length >= sizeof(header) &&
+              header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+              header.vendorID == props.vendorID && header.deviceID == props.deviceID &&
+              !memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+    }
+
+    if(!valid)
+    {
+      TEST_WARN("Ignoring invalid pipeline cache '%s'", pipelineCachePath.c_str());
+      initialData.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo info = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  info.initialDataSize = initialData.size();
+  info.pInitialData = initialData.empty() ? NULL : initialData.data();
+
+  VkResult vkr = vkCreatePipelineCache(device, &info, NULL, &pipelineCache);
+
+  // if the driver rejects the data anyway, start with an empty cache
+  if(vkr != VK_SUCCESS && !initialData.empty())
+  {
+    TEST_WARN("Driver rejected pipeline cache '%s': %s", pipelineCachePath.c_str(),
+              vkh::result_str(vkr));
+
+    info.initialDataSize = 0;
+    info.pInitialData = NULL;
+    vkr = vkCreatePipelineCache(device, &info, NULL, &pipelineCache);
+  }
+
+  if(vkr != VK_SUCCESS)
+  {
+    TEST_ERROR("Error creating pipeline cache: %s", vkh::result_str(vkr));
+    return false;
+  }
+
+  return true;
+}
+
+void VulkanGraphicsTest::savePipelineCache()
+{
+  if(!pipelineCacheEnabled || pipelineCache == VK_NULL_HANDLE || pipelineCachePath.empty())
+    return;
+
+  WritePipelineCache(device, pipelineCache, pipelineCachePath);
+}
+
+GraphicsWindow *VulkanGraphicsTest::MakeWindow(int width, int height, const char *title)
+{
+#if defined(WIN32)
+  return new Win32Window(width, height, title);
+#else
+  return new X11Window(width, height, title);
+#endif
+}
 
 VulkanGraphicsTest::~VulkanGraphicsTest()
 {
   if(volkGetInstanceVersion() == 0)
     return;
 
-  vmaDestroyAllocator(allocator);
+  // everything this test created is destroyed, but the core objects can be left for the next test
+  bool share = IsResourceSharingEnabled() && device != VK_NULL_HANDLE;
+
+  if(device)
+    vkDeviceWaitIdle(device);
+
+  if(stagingBuffer != VK_NULL_HANDLE)
+    vmaDestroyBuffer(allocator, stagingBuffer, stagingAlloc);
+
+  // any readbacks still outstanding have completed now, so deliver them before the buffers go
+  for(uint32_t i = 0; i < frames.size(); i++)
+  {
+    finishReadback(i);
+
+    if(frames[i].readbackBuffer != VK_NULL_HANDLE)
+      vmaDestroyBuffer(allocator, frames[i].readbackBuffer, frames[i].readbackAlloc);
+  }
+
+  if(!share)
+    vmaDestroyAllocator(allocator);
 
   if(device)
   {
     vkDeviceWaitIdle(device);
 
-    for(VkFence fence : fences)
-      vkDestroyFence(device, fence, NULL);
+    if(gpuTimestamps)
+    {
+      // every other frame slot has completed too, so gather their results before reporting
+      for(uint32_t i = 0; i < frames.size(); i++)
+        readTimestamps(i);
+
+      reportTimestamps();
+    }
 
     for(VkShaderModule shader : shaders)
       vkDestroyShaderModule(device, shader, NULL);
 
-    for(VkDescriptorPool pool : descPools)
-      vkDestroyDescriptorPool(device, pool, NULL);
+    size_t numPools = 0, numFramePools = 0;
+    uint32_t numSets = 0, peakFrameSets = 0;
+
+    for(auto it = descPools.begin(); it != descPools.end(); ++it)
+    {
+      numPools += it->second.pools.size();
+      numSets += it->second.allocated;
+
+      for(VkDescriptorPool pool : it->second.pools)
+        vkDestroyDescriptorPool(device, pool, NULL);
+    }
+
+    for(FrameData &frame : frames)
+    {
+      for(auto it = frame.descPools.begin(); it != frame.descPools.end(); ++it)
+      {
+        numFramePools += it->second.pools.size();
+        peakFrameSets = std::max(peakFrameSets, std::max(it->second.peak, it->second.allocated));
+
+        for(VkDescriptorPool pool : it->second.pools)
+          vkDestroyDescriptorPool(device, pool, NULL);
+      }
+    }
+
+    if(numPools + numFramePools > 0)
+      TEST_LOG("Descriptor pools: %zu holding %u sets, %zu per-frame with at most %u sets a frame",
+               numPools, numSets, numFramePools, peakFrameSets);
 
     for(VkPipeline pipe : pipes)
       vkDestroyPipeline(device, pipe, NULL);
@@ -397,280 +1000,901 @@ VulkanGraphicsTest::~VulkanGraphicsTest()
     for(VkImageView view : imageviews)
       vkDestroyImageView(device, view, NULL);
 
-    for(VkPipelineLayout layout : pipelayouts)
-      vkDestroyPipelineLayout(device, layout, NULL);
+    for(VkPipelineLayout layout : pipelayouts)
+      vkDestroyPipelineLayout(device, layout, NULL);
+
+    for(VkDescriptorSetLayout layout : setlayouts)
+      vkDestroyDescriptorSetLayout(device, layout, NULL);
+
+    for(VkSemaphore sem : semaphores)
+      vkDestroySemaphore(device, sem, NULL);
+
+    if(!share)
+    {
+      savePipelineCache();
+      vkDestroyPipelineCache(device, pipelineCache, NULL);
+    }
+
+    for(VkFence fence : freeFences)
+      vkDestroyFence(device, fence, NULL);
+
+    for(const StagingRange &range : stagingInFlight)
+      vkDestroyFence(device, range.fence, NULL);
+
+    for(FrameData &frame : frames)
+    {
+      vkDestroySemaphore(device, frame.renderStartSemaphore, NULL);
+      vkDestroySemaphore(device, frame.renderEndSemaphore, NULL);
+      vkDestroySemaphore(device, frame.readbackSemaphore, NULL);
+
+      for(VkFence fence : frame.fences)
+        vkDestroyFence(device, fence, NULL);
+
+      for(auto it = frame.cmdPools.begin(); it != frame.cmdPools.end(); ++it)
+        vkDestroyCommandPool(device, it->second.pool, NULL);
+
+      vkDestroyQueryPool(device, frame.queryPool, NULL);
+    }
+
+    destroySwap();
+
+    if(!share)
+      vkDestroyDevice(device, NULL);
+  }
+
+  if(surface)
+    vkDestroySurfaceKHR(instance, surface, NULL);
+
+  if(share)
+  {
+    shareDevice();
+  }
+  else
+  {
+    if(debugReportCallback)
+      vkDestroyDebugReportCallbackEXT(instance, debugReportCallback, NULL);
+
+    if(instance)
+      vkDestroyInstance(instance, NULL);
+  }
+
+  delete mainWindow;
+}
+
+bool VulkanGraphicsTest::Running()
+{
+  if(!FrameLimit())
+    return false;
+
+  if(headless)
+    return true;
+
+  return mainWindow->Update();
+}
+
+VkImage VulkanGraphicsTest::StartUsingBackbuffer(VkCommandBuffer cmd, VkAccessFlags nextUse,
+                                                 VkImageLayout layout)
+{
+  VkImage img = swapImages[swapIndex];
+
+  vkh::cmdPipelineBarrier(
+      cmd, {
+               vkh::ImageMemoryBarrier(0, nextUse, VK_IMAGE_LAYOUT_UNDEFINED, layout, img),
+           });
+
+  return img;
+}
+
+void VulkanGraphicsTest::FinishUsingBackbuffer(VkCommandBuffer cmd, VkAccessFlags prevUse,
+                                               VkImageLayout layout)
+{
+  VkImage img = swapImages[swapIndex];
+
+  // there's no presentation engine to hand off to when headless, so leave the image in a layout
+  // that's valid without VK_KHR_swapchain.
+  VkImageLayout finalLayout = headless ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  vkh::cmdPipelineBarrier(cmd, {
+                                   vkh::ImageMemoryBarrier(prevUse, VK_ACCESS_MEMORY_READ_BIT,
+                                                           layout, finalLayout, img),
+                               });
+}
+
+void VulkanGraphicsTest::Submit(int index, int totalSubmits, const std::vector<VkCommandBuffer> &cmds,
+                                const std::vector<VkSemaphore> &waitSemaphores,
+                                const std::vector<VkSemaphore> &signalSemaphores)
+{
+  std::vector<VkSemaphore> waits = waitSemaphores;
+  std::vector<VkSemaphore> signals = signalSemaphores;
+
+  if(index == 0 && !headless)
+    waits.push_back(frames[frameSlot].renderStartSemaphore);
+
+  if(index == totalSubmits - 1 && !headless)
+    signals.push_back(frames[frameSlot].renderEndSemaphore);
+
+  SubmitToQueue(queue, cmds, waits, signals);
+}
+
+void VulkanGraphicsTest::SubmitToQueue(VkQueue q, const std::vector<VkCommandBuffer> &cmds,
+                                       const std::vector<VkSemaphore> &waitSemaphores,
+                                       const std::vector<VkSemaphore> &signalSemaphores)
+{
+  std::vector<VkPipelineStageFlags> waitStages(waitSemaphores.size(),
+                                               VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  VkSubmitInfo submit = vkh::SubmitInfo(cmds);
+
+  submit.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+  submit.pWaitSemaphores = waitSemaphores.data();
+  submit.pWaitDstStageMask = waitStages.data();
+
+  submit.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+  submit.pSignalSemaphores = signalSemaphores.data();
+
+  CHECK_VKR(vkQueueSubmit(q, 1, &submit, VK_NULL_HANDLE));
+}
+
+void VulkanGraphicsTest::Present()
+{
+  if(curFrame == dumpFrame && !dumpFramePath.empty())
+  {
+    std::string path = dumpFramePath;
+    readbackBackbuffer([path](uint32_t width, uint32_t height, std::vector<byte> &rgba) {
+      WritePNGAsync(path, width, height, std::move(rgba));
+    });
+  }
+
+  // a readback copies from the backbuffer after rendering, so presenting has to wait for it
+  VkSemaphore presentWait = frames[frameSlot].renderEndSemaphore;
+
+  if(pendingReadback)
+    presentWait = recordReadback(frameSlot);
+
+  if(!headless)
+  {
+    VkResult vkr = vkQueuePresentKHR(queue, vkh::PresentInfoKHR(swap, swapIndex, &presentWait));
+
+    if(vkr == VK_SUBOPTIMAL_KHR || vkr == VK_ERROR_OUT_OF_DATE_KHR)
+      resize();
+  }
+
+  // signal this frame's fences once everything submitted so far has completed. This is done with
+  // an empty submit so that tests can submit as many times as they like during a frame.
+  for(size_t i = 0; i < queues.size(); i++)
+    CHECK_VKR(vkQueueSubmit(queues[i], 0, NULL, frames[frameSlot].fences[i]));
+
+  // move to the next frame, and only wait if the GPU is still working on the frame that last used
+  // it. With one frame in flight this waits for the frame we just submitted.
+  frameSlot = (frameSlot + 1) % framesInFlight;
+
+  FrameData &frame = frames[frameSlot];
+
+  CHECK_VKR(vkWaitForFences(device, (uint32_t)frame.fences.size(), frame.fences.data(), VK_TRUE,
+                            UINT64_MAX));
+  CHECK_VKR(vkResetFences(device, (uint32_t)frame.fences.size(), frame.fences.data()));
+
+  if(gpuTimestamps)
+  {
+    readTimestamps(frameSlot);
+
+    // any regions left open by the last frame can't be closed now
+    std::lock_guard<std::mutex> lock(timestampLock);
+    openRegions.clear();
+  }
+
+  finishReadback(frameSlot);
+
+  // everything from this slot's last frame has now completed, so its command buffers and
+  // descriptor sets can all be recycled at once
+  for(auto it = frame.cmdPools.begin(); it != frame.cmdPools.end(); ++it)
+  {
+    CHECK_VKR(vkResetCommandPool(device, it->second.pool, 0));
+
+    for(size_t &used : it->second.used)
+      used = 0;
+  }
+
+  for(auto it = frame.descPools.begin(); it != frame.descPools.end(); ++it)
+    resetPools(it->second);
+
+  if(gpuTimestamps)
+    resetTimestampQueries();
+
+  acquireImage();
+}
+
+VkPipelineShaderStageCreateInfo VulkanGraphicsTest::CompileShaderModule(
+    const std::string &source_text, ShaderLang lang, ShaderStage stage, const char *entry_point)
+{
+  return CreateShaderStage(::CompileShaderToSpv(source_text, lang, stage, entry_point), stage,
+                           entry_point);
+}
+
+std::vector<VkPipelineShaderStageCreateInfo> VulkanGraphicsTest::CompileShaderModules(
+    const std::vector<ShaderCompileJob> &jobs)
+{
+  std::vector<std::vector<uint32_t>> spirv = ::CompileShadersToSpv(jobs);
+
+  std::vector<VkPipelineShaderStageCreateInfo> ret;
+  for(size_t i = 0; i < jobs.size(); i++)
+    ret.push_back(CreateShaderStage(spirv[i], jobs[i].stage, jobs[i].entry_point));
+
+  return ret;
+}
+
+VkPipelineShaderStageCreateInfo VulkanGraphicsTest::CreateShaderStage(
+    const std::vector<uint32_t> &spirv, ShaderStage stage, const char *entry_point)
+{
+  VkShaderModule ret = VK_NULL_HANDLE;
+
+  if(spirv.empty())
+    return {};
+
+  CHECK_VKR(vkCreateShaderModule(device, vkh::ShaderModuleCreateInfo(spirv), NULL, &ret));
+
+  shaders.push_back(ret);
+
+  VkShaderStageFlagBits vkstage[] = {
+      VK_SHADER_STAGE_VERTEX_BIT,
+      VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+      VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+      VK_SHADER_STAGE_GEOMETRY_BIT,
+      VK_SHADER_STAGE_FRAGMENT_BIT,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+  };
+
+  return vkh::PipelineShaderStageCreateInfo(ret, vkstage[(int)stage], entry_point);
+}
+
+VkCommandBuffer VulkanGraphicsTest::GetCommandBuffer(VkCommandBufferLevel level,
+                                                     uint32_t queueFamily)
+{
+  if(queueFamily == ~0U)
+    queueFamily = queueFamilyIndex;
+
+  CommandPool *poolPtr = NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(cmdPoolLock);
+    poolPtr = &frames[frameSlot].cmdPools[std::make_pair(std::this_thread::get_id(), queueFamily)];
+  }
+
+  CommandPool &pool = *poolPtr;
+
+  if(pool.pool == VK_NULL_HANDLE)
+    CHECK_VKR(vkCreateCommandPool(
+        device, vkh::CommandPoolCreateInfo(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queueFamily), NULL,
+        &pool.pool));
+
+  std::vector<VkCommandBuffer> &buflist = pool.buffers[level];
+  size_t &used = pool.used[level];
+
+  if(used == buflist.size())
+  {
+    // grow geometrically so that tests using many command buffers a frame allocate rarely
+    uint32_t count = std::max(4U, (uint32_t)buflist.size());
+
+    buflist.resize(buflist.size() + count);
+    CHECK_VKR(vkAllocateCommandBuffers(
+        device, vkh::CommandBufferAllocateInfo(pool.pool, count, level), &buflist[used]));
+  }
+
+  return buflist[used++];
+}
+
+void VulkanGraphicsTest::uploadBuffer(VkBuffer dst, VkDeviceSize offset, const void *data,
+                                      size_t size)
+{
+  VkDeviceSize srcOffset = allocateStaging(size);
+
+  memcpy(stagingData + srcOffset, data, size);
+
+  stagedBufferCopies.push_back({dst, {srcOffset, offset, size}});
+}
+
+void VulkanGraphicsTest::uploadImage(VkImage dst, VkImageLayout finalLayout, VkExtent3D extent,
+                                     const void *data, size_t size,
+                                     VkImageSubresourceLayers subresource, VkOffset3D offset)
+{
+  VkDeviceSize srcOffset = allocateStaging(size);
+
+  memcpy(stagingData + srcOffset, data, size);
+
+  StagedImageCopy copy = {dst, finalLayout};
+  copy.region.bufferOffset = srcOffset;
+  copy.region.imageSubresource = subresource;
+  copy.region.imageOffset = offset;
+  copy.region.imageExtent = extent;
+
+  stagedImageCopies.push_back(copy);
+}
+
+void VulkanGraphicsTest::flushUploads()
+{
+  if(stagedBufferCopies.empty() && stagedImageCopies.empty())
+    return;
+
+  VkCommandBuffer cmd = GetCommandBuffer();
+
+  CHECK_VKR(vkBeginCommandBuffer(
+      cmd, vkh::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT)));
+
+  // images need to be in the right layout for the copy. Each is only transitioned once, since
+  // doing it again would discard earlier copies to other subresources
+  std::vector<VkImageMemoryBarrier> imgBarriers;
+  std::set<VkImage> images;
+
+  for(const StagedImageCopy &copy : stagedImageCopies)
+  {
+    if(images.insert(copy.dst).second)
+      imgBarriers.push_back(vkh::ImageMemoryBarrier(
+          0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy.dst,
+          vkh::ImageSubresourceRange(copy.region.imageSubresource.aspectMask)));
+  }
+
+  if(!imgBarriers.empty())
+    vkh::cmdPipelineBarrier(cmd, imgBarriers, {}, {}, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+  for(const StagedBufferCopy &copy : stagedBufferCopies)
+    vkCmdCopyBuffer(cmd, stagingBuffer, copy.dst, 1, &copy.region);
+
+  for(const StagedImageCopy &copy : stagedImageCopies)
+    vkCmdCopyBufferToImage(cmd, stagingBuffer, copy.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &copy.region);
+
+  // make every copy visible to any later use in one barrier. Buffers are covered by a global
+  // memory barrier, images also need moving to their final layout
+  imgBarriers.clear();
+  images.clear();
+
+  for(const StagedImageCopy &copy : stagedImageCopies)
+  {
+    if(images.insert(copy.dst).second)
+      imgBarriers.push_back(vkh::ImageMemoryBarrier(
+          VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy.finalLayout, copy.dst,
+          vkh::ImageSubresourceRange(copy.region.imageSubresource.aspectMask)));
+  }
+
+  vkh::cmdPipelineBarrier(
+      cmd, imgBarriers, {},
+      {vkh::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT)},
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  CHECK_VKR(vkEndCommandBuffer(cmd));
+
+  VkFence fence = allocateFence();
+
+  CHECK_VKR(vkQueueSubmit(queue, 1, vkh::SubmitInfo({cmd}), fence));
+
+  stagingInFlight.push_back({fence, stagingFlushStart, stagingHead});
+  stagingFlushStart = stagingHead;
+
+  stagedBufferCopies.clear();
+  stagedImageCopies.clear();
+}
+
+VkDeviceSize VulkanGraphicsTest::allocateStaging(VkDeviceSize size)
+{
+  // sufficient for buffer copies and for images with any power-of-two texel size
+  const VkDeviceSize alignment = 16;
+
+  VkDeviceSize offset = (stagingHead + alignment - 1) & ~(alignment - 1);
+
+  if(stagingBuffer == VK_NULL_HANDLE || size > stagingSize)
+  {
+    // the ring is too small (or doesn't exist yet). Drain it and create a bigger one
+    if(stagingBuffer != VK_NULL_HANDLE)
+    {
+      flushUploads();
+
+      CHECK_VKR(vkQueueWaitIdle(queue));
+
+      for(const StagingRange &range : stagingInFlight)
+      {
+        CHECK_VKR(vkResetFences(device, 1, &range.fence));
+        freeFences.push_back(range.fence);
+      }
+      stagingInFlight.clear();
+
+      vmaDestroyBuffer(allocator, stagingBuffer, stagingAlloc);
+    }
+
+    while(stagingSize < size)
+      stagingSize *= 2;
+
+    VmaAllocationCreateInfo allocInfo = {VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                         VMA_MEMORY_USAGE_CPU_ONLY};
+    VmaAllocationInfo mapped = {};
+
+    CHECK_VKR(vmaCreateBuffer(allocator,
+                              vkh::BufferCreateInfo(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+                              &allocInfo, &stagingBuffer, &stagingAlloc, &mapped));
+
+    stagingData = (byte *)mapped.pMappedData;
+
+    offset = stagingHead = stagingFlushStart = 0;
+  }
+  else if(offset + size > stagingSize)
+  {
+    // wrap around to the start. Anything queued at the end of the ring is flushed first so that
+    // each flush covers a contiguous range
+    flushUploads();
+
+    offset = stagingHead = stagingFlushStart = 0;
+  }
+
+  // wait for the oldest flushes until the range we want is no longer in use. In-flight ranges
+  // follow on from the head in ring order, so once the oldest doesn't overlap none of them do
+  while(!stagingInFlight.empty())
+  {
+    const StagingRange &range = stagingInFlight.front();
+
+    if(range.begin >= offset + size || range.end <= offset)
+      break;
+
+    CHECK_VKR(vkWaitForFences(device, 1, &range.fence, VK_TRUE, UINT64_MAX));
+    CHECK_VKR(vkResetFences(device, 1, &range.fence));
+    freeFences.push_back(range.fence);
+
+    stagingInFlight.pop_front();
+  }
+
+  stagingHead = offset + size;
+
+  return offset;
+}
+
+VkFence VulkanGraphicsTest::allocateFence()
+{
+  if(freeFences.empty())
+  {
+    VkFence fence = VK_NULL_HANDLE;
+    CHECK_VKR(vkCreateFence(device, vkh::FenceCreateInfo(), NULL, &fence));
+    return fence;
+  }
+
+  VkFence ret = freeFences.back();
+  freeFences.pop_back();
+  return ret;
+}
+
+template <>
+void VulkanGraphicsTest::setName(VkPipeline obj, const std::string &name)
+{
+  setName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)(uintptr_t)obj, name);
+}
+
+void VulkanGraphicsTest::setName(VkObjectType objType, uint64_t obj, const std::string &name)
+{
+  if(vkSetDebugUtilsObjectNameEXT)
+  {
+    VkDebugUtilsObjectNameInfoEXT info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+    info.objectType = objType;
+    info.objectHandle = obj;
+    info.pObjectName = name.c_str();
+    vkSetDebugUtilsObjectNameEXT(device, &info);
+  }
+}
+
+// pushed in place of a region index for a marker region that isn't timed
+static const size_t NoTimestampRegion = SIZE_MAX;
+
+void VulkanGraphicsTest::pushMarker(VkCommandBuffer cmd, const std::string &name)
+{
+  if(vkCmdBeginDebugUtilsLabelEXT)
+  {
+    VkDebugUtilsLabelEXT info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    info.pLabelName = name.c_str();
+    vkCmdBeginDebugUtilsLabelEXT(cmd, &info);
+  }
+
+  if(gpuTimestamps)
+  {
+    std::lock_guard<std::mutex> lock(timestampLock);
+
+    FrameData &frame = frames[frameSlot];
+    std::vector<size_t> &open = openRegions[cmd];
+
+    if(frame.queriesUsed + 2 > maxTimestampQueries)
+    {
+      // keep the stack balanced even though this region isn't timed
+      open.push_back(NoTimestampRegion);
+      return;
+    }
+
+    // nested regions are named by their path, e.g. "Parent/Child"
+    std::string path = name;
+    if(!open.empty() && open.back() != NoTimestampRegion)
+      path = frame.regions[open.back()].name + "/" + name;
+
+    TimestampRegion region = {path, frame.queriesUsed, frame.queriesUsed + 1};
+    frame.queriesUsed += 2;
+
+    open.push_back(frame.regions.size());
+    frame.regions.push_back(region);
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, region.begin);
+  }
+}
+
+void VulkanGraphicsTest::setMarker(VkCommandBuffer cmd, const std::string &name)
+{
+  if(vkCmdInsertDebugUtilsLabelEXT)
+  {
+    VkDebugUtilsLabelEXT info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    info.pLabelName = name.c_str();
+    vkCmdInsertDebugUtilsLabelEXT(cmd, &info);
+  }
+}
+
+void VulkanGraphicsTest::popMarker(VkCommandBuffer cmd)
+{
+  if(vkCmdEndDebugUtilsLabelEXT)
+  {
+    vkCmdEndDebugUtilsLabelEXT(cmd);
+  }
+
+  if(gpuTimestamps)
+  {
+    std::lock_guard<std::mutex> lock(timestampLock);
 
-    for(VkDescriptorSetLayout layout : setlayouts)
-      vkDestroyDescriptorSetLayout(device, layout, NULL);
+    auto it = openRegions.find(cmd);
+    if(it == openRegions.end() || it->second.empty())
+      return;
 
-    vkDestroyCommandPool(device, cmdPool, NULL);
-    vkDestroySemaphore(device, renderStartSemaphore, NULL);
-    vkDestroySemaphore(device, renderEndSemaphore, NULL);
+    size_t idx = it->second.back();
+    it->second.pop_back();
 
-    destroySwap();
+    if(it->second.empty())
+      openRegions.erase(it);
 
-    vkDestroyDevice(device, NULL);
+    if(idx != NoTimestampRegion)
+    {
+      FrameData &frame = frames[frameSlot];
+      vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPool,
+                          frame.regions[idx].end);
+    }
   }
+}
 
-  if(debugReportCallback)
-    vkDestroyDebugReportCallbackEXT(instance, debugReportCallback, NULL);
-  if(surface)
-    vkDestroySurfaceKHR(instance, surface, NULL);
+void VulkanGraphicsTest::resetTimestampQueries()
+{
+  // submitted as soon as the frame starts, so it's ahead of anything a test submits to the graphics
+  // queue this frame no matter which function it submits with
+  VkCommandBuffer cmd = GetCommandBuffer();
 
-  if(instance)
-    vkDestroyInstance(instance, NULL);
+  CHECK_VKR(vkBeginCommandBuffer(
+      cmd, vkh::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT)));
+  vkCmdResetQueryPool(cmd, frames[frameSlot].queryPool, 0, maxTimestampQueries);
+  CHECK_VKR(vkEndCommandBuffer(cmd));
 
-  delete mainWindow;
+  SubmitToQueue(queue, {cmd});
 }
 
-bool VulkanGraphicsTest::Running()
+void VulkanGraphicsTest::readTimestamps(uint32_t slot)
 {
-  if(!FrameLimit())
-    return false;
+  FrameData &frame = frames[slot];
 
-  return mainWindow->Update();
-}
+  if(frame.queriesUsed > 0)
+  {
+    // read each query along with its availability, so that regions which were never closed or
+    // never submitted are skipped rather than failing the whole read
+    std::vector<uint64_t> results(frame.queriesUsed * 2);
 
-VkImage VulkanGraphicsTest::StartUsingBackbuffer(VkCommandBuffer cmd, VkAccessFlags nextUse,
-                                                 VkImageLayout layout)
-{
-  VkImage img = swapImages[swapIndex];
+    VkResult vkr = vkGetQueryPoolResults(
+        device, frame.queryPool, 0, frame.queriesUsed, results.size() * sizeof(uint64_t),
+        results.data(), sizeof(uint64_t) * 2,
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
 
-  vkh::cmdPipelineBarrier(
-      cmd, {
-               vkh::ImageMemoryBarrier(0, nextUse, VK_IMAGE_LAYOUT_UNDEFINED, layout, img),
-           });
+    if(vkr == VK_SUCCESS || vkr == VK_NOT_READY)
+    {
+      for(const TimestampRegion &region : frame.regions)
+      {
+        if(!results[region.begin * 2 + 1] || !results[region.end * 2 + 1])
+          continue;
 
-  return img;
-}
+        uint64_t ticks = (results[region.end * 2] - results[region.begin * 2]) & timestampMask;
+        double ms = double(ticks) * timestampPeriod / 1000000.0;
 
-void VulkanGraphicsTest::FinishUsingBackbuffer(VkCommandBuffer cmd, VkAccessFlags prevUse,
-                                               VkImageLayout layout)
-{
-  VkImage img = swapImages[swapIndex];
+        auto it = timestampStats.find(region.name);
+        if(it == timestampStats.end())
+        {
+          timestampNames.push_back(region.name);
+          timestampStats[region.name] = {1, ms, ms, ms};
+        }
+        else
+        {
+          it->second.count++;
+          it->second.total += ms;
+          it->second.min = std::min(it->second.min, ms);
+          it->second.max = std::max(it->second.max, ms);
+        }
+      }
+    }
+  }
 
-  vkh::cmdPipelineBarrier(cmd, {
-                                   vkh::ImageMemoryBarrier(prevUse, VK_ACCESS_MEMORY_READ_BIT, layout,
-                                                           VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, img),
-                               });
+  frame.regions.clear();
+  frame.queriesUsed = 0;
 }
 
-void VulkanGraphicsTest::Submit(int index, int totalSubmits, const std::vector<VkCommandBuffer> &cmds,
-                                const std::vector<VkCommandBuffer> &seccmds)
+void VulkanGraphicsTest::reportTimestamps()
 {
-  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  if(timestampNames.empty())
+  {
+    TEST_LOG("No GPU timestamps were recorded");
+    return;
+  }
 
-  VkSubmitInfo submit = vkh::SubmitInfo(cmds);
+  TEST_LOG("GPU time per marker region (ms):");
+  TEST_LOG("%-48s %8s %10s %10s %10s", "Region", "Count", "Avg", "Min", "Max");
 
-  if(index == 0)
+  for(const std::string &name : timestampNames)
   {
-    submit.waitSemaphoreCount = 1;
-    submit.pWaitDstStageMask = &waitStage;
-    submit.pWaitSemaphores = &renderStartSemaphore;
+    const TimestampStats &stats = timestampStats[name];
+    TEST_LOG("%-48s %8u %10.4f %10.4f %10.4f", name.c_str(), stats.count,
+             stats.total / stats.count, stats.min, stats.max);
   }
 
-  if(index == totalSubmits - 1)
+  if(gpuTimestampsJson.empty())
+    return;
+
+  std::string json = "{\n  \"regions\": [\n";
+
+  for(size_t i = 0; i < timestampNames.size(); i++)
   {
-    submit.signalSemaphoreCount = 1;
-    submit.pSignalSemaphores = &renderEndSemaphore;
-  }
+    const TimestampStats &stats = timestampStats[timestampNames[i]];
 
-  VkFence fence;
-  CHECK_VKR(vkCreateFence(device, vkh::FenceCreateInfo(), NULL, &fence));
+    std::string name;
+    for(char c : timestampNames[i])
+    {
+      if(c == '"' || c == '\\')
+        name += '\\';
+      name += c;
+    }
 
-  fences.insert(fence);
+    char line[256];
+    snprintf(line, sizeof(line) - 1,
+             ", \"count\": %u, \"avg_ms\": %f, \"min_ms\": %f, \"max_ms\": %f}%s\n", stats.count,
+             stats.total / stats.count, stats.min, stats.max,
+             i + 1 < timestampNames.size() ? "," : "");
 
-  for(const VkCommandBuffer &cmd : cmds)
-    pendingCommandBuffers[0].push_back(std::make_pair(cmd, fence));
+    json += "    {\"name\": \"" + name + "\"" + line;
+  }
 
-  for(const VkCommandBuffer &cmd : seccmds)
-    pendingCommandBuffers[1].push_back(std::make_pair(cmd, fence));
+  json += "  ]\n}\n";
 
-  vkQueueSubmit(queue, 1, &submit, fence);
+  if(!WriteFileAtomically(gpuTimestampsJson, json.data(), json.size()))
+    TEST_WARN("Couldn't write GPU timestamps to '%s'", gpuTimestampsJson.c_str());
 }
 
-void VulkanGraphicsTest::Present()
+void VulkanGraphicsTest::readbackBackbuffer(ReadbackCallback callback)
 {
-  VkResult vkr = vkQueuePresentKHR(queue, vkh::PresentInfoKHR(swap, swapIndex, &renderEndSemaphore));
+  if(!backbufferReadable)
+  {
+    TEST_WARN("The swapchain doesn't support copies, the backbuffer can't be read back");
+    return;
+  }
 
-  if(vkr == VK_SUBOPTIMAL_KHR || vkr == VK_ERROR_OUT_OF_DATE_KHR)
-    resize();
+  pendingReadback = callback;
+}
 
-  vkQueueWaitIdle(queue);
+VkSemaphore VulkanGraphicsTest::recordReadback(uint32_t slot)
+{
+  FrameData &frame = frames[slot];
 
-  std::set<VkFence> doneFences;
+  VkExtent2D extent = swapExtent;
+  VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
 
-  for(int level = 0; level < VK_COMMAND_BUFFER_LEVEL_RANGE_SIZE; level++)
+  // each frame slot has its own buffer, and this slot's last frame has completed so it's free to
+  // be replaced if it's too small
+  if(frame.readbackSize < size)
   {
-    for(auto it = pendingCommandBuffers[level].begin(); it != pendingCommandBuffers[level].end();)
-    {
-      if(vkGetFenceStatus(device, it->second) == VK_SUCCESS)
-      {
-        freeCommandBuffers[level].push_back(it->first);
-        doneFences.insert(it->second);
-        it = pendingCommandBuffers[level].erase(it);
-      }
-      else
-      {
-        ++it;
-      }
-    }
-  }
+    if(frame.readbackBuffer != VK_NULL_HANDLE)
+      vmaDestroyBuffer(allocator, frame.readbackBuffer, frame.readbackAlloc);
 
-  for(auto it = doneFences.begin(); it != doneFences.end(); ++it)
-  {
-    vkDestroyFence(device, *it, NULL);
-    fences.erase(*it);
+    VmaAllocationCreateInfo allocInfo = {VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                         VMA_MEMORY_USAGE_GPU_TO_CPU};
+    VmaAllocationInfo mapped = {};
+
+    CHECK_VKR(vmaCreateBuffer(allocator,
+                              vkh::BufferCreateInfo(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+                              &allocInfo, &frame.readbackBuffer, &frame.readbackAlloc, &mapped));
+
+    frame.readbackData = (byte *)mapped.pMappedData;
+    frame.readbackSize = size;
   }
 
-  acquireImage();
-}
+  if(!headless && frame.readbackSemaphore == VK_NULL_HANDLE)
+    CHECK_VKR(
+        vkCreateSemaphore(device, vkh::SemaphoreCreateInfo(), NULL, &frame.readbackSemaphore));
 
-VkPipelineShaderStageCreateInfo VulkanGraphicsTest::CompileShaderModule(
-    const std::string &source_text, ShaderLang lang, ShaderStage stage, const char *entry_point)
-{
-  VkShaderModule ret = VK_NULL_HANDLE;
+  VkImage img = swapImages[swapIndex];
+  VkImageLayout layout = headless ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
-  std::vector<uint32_t> spirv = ::CompileShaderToSpv(source_text, lang, stage, entry_point);
+  VkCommandBuffer cmd = GetCommandBuffer();
 
-  if(spirv.empty())
-    return {};
+  CHECK_VKR(vkBeginCommandBuffer(
+      cmd, vkh::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT)));
 
-  CHECK_VKR(vkCreateShaderModule(device, vkh::ShaderModuleCreateInfo(spirv), NULL, &ret));
+  vkh::cmdPipelineBarrier(
+      cmd, {
+               vkh::ImageMemoryBarrier(0, VK_ACCESS_TRANSFER_READ_BIT, layout,
+                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, img),
+           });
 
-  shaders.push_back(ret);
+  VkBufferImageCopy region = {};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {extent.width, extent.height, 1};
 
-  VkShaderStageFlagBits vkstage[] = {
-      VK_SHADER_STAGE_VERTEX_BIT,
-      VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
-      VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
-      VK_SHADER_STAGE_GEOMETRY_BIT,
-      VK_SHADER_STAGE_FRAGMENT_BIT,
-      VK_SHADER_STAGE_COMPUTE_BIT,
-  };
+  vkCmdCopyImageToBuffer(cmd, img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readbackBuffer, 1,
+                         &region);
 
-  return vkh::PipelineShaderStageCreateInfo(ret, vkstage[(int)stage], entry_point);
-}
+  vkh::cmdPipelineBarrier(
+      cmd,
+      {
+          vkh::ImageMemoryBarrier(VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_MEMORY_READ_BIT,
+                                  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout, img),
+      },
+      {
+          vkh::BufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                                   frame.readbackBuffer),
+      });
 
-VkCommandBuffer VulkanGraphicsTest::GetCommandBuffer(VkCommandBufferLevel level)
-{
-  std::vector<VkCommandBuffer> &buflist = freeCommandBuffers[level];
+  CHECK_VKR(vkEndCommandBuffer(cmd));
 
-  if(buflist.empty())
-  {
-    buflist.resize(4);
-    CHECK_VKR(vkAllocateCommandBuffers(device, vkh::CommandBufferAllocateInfo(cmdPool, 4, level),
-                                       &buflist[0]));
-  }
+  if(headless)
+    SubmitToQueue(queue, {cmd});
+  else
+    SubmitToQueue(queue, {cmd}, {frame.renderEndSemaphore}, {frame.readbackSemaphore});
 
-  VkCommandBuffer ret = buflist.back();
-  buflist.pop_back();
+  frame.readbackExtent = extent;
+  frame.readbackFormat = swapFormat;
+  frame.readbackCallback = pendingReadback;
+  pendingReadback = nullptr;
 
-  return ret;
+  return frame.readbackSemaphore;
 }
 
-template <>
-void VulkanGraphicsTest::setName(VkPipeline obj, const std::string &name)
+void VulkanGraphicsTest::finishReadback(uint32_t slot)
 {
-  setName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)(uintptr_t)obj, name);
-}
+  FrameData &frame = frames[slot];
 
-void VulkanGraphicsTest::setName(VkObjectType objType, uint64_t obj, const std::string &name)
-{
-  if(vkSetDebugUtilsObjectNameEXT)
+  if(!frame.readbackCallback)
+    return;
+
+  ReadbackCallback callback = frame.readbackCallback;
+  frame.readbackCallback = nullptr;
+
+  bool bgra = false;
+
+  switch(frame.readbackFormat)
   {
-    VkDebugUtilsObjectNameInfoEXT info = {};
-    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
-    info.objectType = objType;
-    info.objectHandle = obj;
-    info.pObjectName = name.c_str();
-    vkSetDebugUtilsObjectNameEXT(device, &info);
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB: bgra = true; break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB: break;
+    default:
+      TEST_WARN("Can't read back backbuffer in format %d", frame.readbackFormat);
+      return;
   }
-}
 
-void VulkanGraphicsTest::pushMarker(VkCommandBuffer cmd, const std::string &name)
-{
-  if(vkCmdBeginDebugUtilsLabelEXT)
+  vmaInvalidateAllocation(allocator, frame.readbackAlloc, 0, VK_WHOLE_SIZE);
+
+  size_t size = size_t(frame.readbackExtent.width) * frame.readbackExtent.height * 4;
+  std::vector<byte> rgba(frame.readbackData, frame.readbackData + size);
+
+  if(bgra)
   {
-    VkDebugUtilsLabelEXT info = {};
-    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
-    info.pLabelName = name.c_str();
-    vkCmdBeginDebugUtilsLabelEXT(cmd, &info);
+    for(size_t i = 0; i < size; i += 4)
+      std::swap(rgba[i], rgba[i + 2]);
   }
+
+  callback(frame.readbackExtent.width, frame.readbackExtent.height, rgba);
 }
 
-void VulkanGraphicsTest::setMarker(VkCommandBuffer cmd, const std::string &name)
+VkDescriptorSet VulkanGraphicsTest::allocateDescriptorSet(VkDescriptorSetLayout setLayout)
 {
-  if(vkCmdInsertDebugUtilsLabelEXT)
-  {
-    VkDebugUtilsLabelEXT info = {};
-    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
-    info.pLabelName = name.c_str();
-    vkCmdInsertDebugUtilsLabelEXT(cmd, &info);
-  }
+  return allocateFromPools(descPools[setLayout], setLayout);
 }
 
-void VulkanGraphicsTest::popMarker(VkCommandBuffer cmd)
+VkDescriptorSet VulkanGraphicsTest::allocateFrameDescriptorSet(VkDescriptorSetLayout setLayout)
 {
-  if(vkCmdEndDebugUtilsLabelEXT)
-  {
-    vkCmdEndDebugUtilsLabelEXT(cmd);
-  }
+  return allocateFromPools(frames[frameSlot].descPools[setLayout], setLayout);
 }
 
-VkDescriptorSet VulkanGraphicsTest::allocateDescriptorSet(VkDescriptorSetLayout setLayout)
+VkDescriptorSet VulkanGraphicsTest::allocateFromPools(DescriptorPoolList &list,
+                                                      VkDescriptorSetLayout setLayout)
 {
-  VkDescriptorSet ret = VK_NULL_HANDLE;
-
-  if(!descPools.empty())
+  // move to the next pool once the current one is full. We track this ourselves since running out
+  // of space in a pool is only reported as an error with VK_KHR_maintenance1
+  while(list.current < list.pools.size() && list.used >= list.capacity[list.current])
   {
-    VkDescriptorPool pool = descPools.back();
-    VkResult vkr =
-        vkAllocateDescriptorSets(device, vkh::DescriptorSetAllocateInfo(pool, {setLayout}), &ret);
-    if(vkr == VK_SUCCESS)
-      return ret;
+    list.current++;
+    list.used = 0;
   }
 
-  // failed to allocate, create a new pool and push it
+  if(list.current == list.pools.size())
   {
+    std::vector<VkDescriptorPoolSize> sizes;
+
+    auto it = setLayoutSizes.find(setLayout);
+    if(it != setLayoutSizes.end())
+    {
+      sizes = it->second;
+    }
+    else
+    {
+      // layout wasn't created through createDescriptorSetLayout, so allow a few of everything
+      for(uint32_t type = VK_DESCRIPTOR_TYPE_BEGIN_RANGE; type <= VK_DESCRIPTOR_TYPE_END_RANGE;
+          type++)
+        sizes.push_back({(VkDescriptorType)type, 8});
+    }
+
+    // pools can't be empty, even for a layout with no bindings
+    if(sizes.empty())
+      sizes.push_back({VK_DESCRIPTOR_TYPE_SAMPLER, 1});
+
+    // start small since most layouts only have a handful of sets, and double with each new pool
+    uint32_t maxSets = std::min(16U << std::min<size_t>(list.pools.size(), 6), 1024U);
+
+    for(VkDescriptorPoolSize &size : sizes)
+      size.descriptorCount *= maxSets;
+
     VkDescriptorPool pool = VK_NULL_HANDLE;
-    CHECK_VKR(vkCreateDescriptorPool(
-        device, vkh::DescriptorPoolCreateInfo(128,
-                                              {
-                                                  {VK_DESCRIPTOR_TYPE_SAMPLER, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1024},
-                                                  {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1024},
-                                              }),
-        NULL, &pool));
-    descPools.push_back(pool);
-
-    // this must succeed or we can't continue.
-    CHECK_VKR(
-        vkAllocateDescriptorSets(device, vkh::DescriptorSetAllocateInfo(pool, {setLayout}), &ret));
-    return ret;
+    CHECK_VKR(vkCreateDescriptorPool(device, vkh::DescriptorPoolCreateInfo(maxSets, sizes), NULL,
+                                     &pool));
+
+    list.pools.push_back(pool);
+    list.capacity.push_back(maxSets);
+    list.used = 0;
   }
+
+  VkDescriptorSet ret = VK_NULL_HANDLE;
+
+  // the pool is sized for this layout so this must succeed
+  CHECK_VKR(vkAllocateDescriptorSets(
+      device, vkh::DescriptorSetAllocateInfo(list.pools[list.current], {setLayout}), &ret));
+
+  list.used++;
+  list.allocated++;
+
+  return ret;
+}
+
+void VulkanGraphicsTest::resetPools(DescriptorPoolList &list)
+{
+  for(VkDescriptorPool pool : list.pools)
+    CHECK_VKR(vkResetDescriptorPool(device, pool, 0));
+
+  list.peak = std::max(list.peak, list.allocated);
+  list.allocated = 0;
+  list.current = 0;
+  list.used = 0;
 }
 
 VkPipeline VulkanGraphicsTest::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo *info)
 {
+  PROFILE_ZONE("createGraphicsPipeline");
+
   VkPipeline ret;
-  CHECK_VKR(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, info, NULL, &ret));
+  CHECK_VKR(vkCreateGraphicsPipelines(device, pipelineCache, 1, info, NULL, &ret));
   pipes.push_back(ret);
   return ret;
 }
 
 VkPipeline VulkanGraphicsTest::createComputePipeline(const VkComputePipelineCreateInfo *info)
 {
+  PROFILE_ZONE("createComputePipeline");
+
   VkPipeline ret;
-  CHECK_VKR(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, info, NULL, &ret));
+  CHECK_VKR(vkCreateComputePipelines(device, pipelineCache, 1, info, NULL, &ret));
   pipes.push_back(ret);
   return ret;
 }
@@ -713,6 +1937,34 @@ VkDescriptorSetLayout VulkanGraphicsTest::createDescriptorSetLayout(
   VkDescriptorSetLayout ret;
   CHECK_VKR(vkCreateDescriptorSetLayout(device, info, NULL, &ret));
   setlayouts.push_back(ret);
+
+  std::vector<VkDescriptorPoolSize> &sizes = setLayoutSizes[ret];
+
+  for(uint32_t i = 0; i < info->bindingCount; i++)
+  {
+    const VkDescriptorSetLayoutBinding &bind = info->pBindings[i];
+
+    if(bind.descriptorCount == 0)
+      continue;
+
+    auto it = std::find_if(sizes.begin(), sizes.end(), [&bind](const VkDescriptorPoolSize &size) {
+      return size.type == bind.descriptorType;
+    });
+
+    if(it == sizes.end())
+      sizes.push_back({bind.descriptorType, bind.descriptorCount});
+    else
+      it->descriptorCount += bind.descriptorCount;
+  }
+
+  return ret;
+}
+
+VkSemaphore VulkanGraphicsTest::createSemaphore()
+{
+  VkSemaphore ret;
+  CHECK_VKR(vkCreateSemaphore(device, vkh::SemaphoreCreateInfo(), NULL, &ret));
+  semaphores.push_back(ret);
   return ret;
 }
 
@@ -788,13 +2040,19 @@ bool VulkanGraphicsTest::createSwap()
   height = std::max(height, capabilities.minImageExtent.height);
 
   viewport = vkh::Viewport(0, 0, (float)width, (float)height, 0.0f, 1.0f);
+  swapExtent = {width, height};
   scissor = vkh::Rect2D({0, 0}, {width, height});
 
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+  // copying from the swapchain is optional, it's only needed to read back the backbuffer
+  backbufferReadable = (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+  if(backbufferReadable)
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
   CHECK_VKR(vkCreateSwapchainKHR(
-      device, vkh::SwapchainCreateInfoKHR(
-                  surface, mode, format, {width, height},
-                  VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT),
-      NULL, &swap));
+      device, vkh::SwapchainCreateInfoKHR(surface, mode, format, {width, height}, usage), NULL,
+      &swap));
 
   CHECK_VKR(vkh::getSwapchainImagesKHR(swapImages, device, swap));
 
@@ -825,6 +2083,92 @@ bool VulkanGraphicsTest::createSwap()
   return true;
 }
 
+bool VulkanGraphicsTest::createHeadlessImages()
+{
+  swapFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  backbufferReadable = true;
+
+  uint32_t width = (uint32_t)screenWidth, height = (uint32_t)screenHeight;
+
+  viewport = vkh::Viewport(0, 0, (float)width, (float)height, 0.0f, 1.0f);
+  swapExtent = {width, height};
+  scissor = vkh::Rect2D({0, 0}, {width, height});
+
+  VkPhysicalDeviceMemoryProperties memProps;
+  vkGetPhysicalDeviceMemoryProperties(phys, &memProps);
+
+  swapImages.resize(headlessImageCount);
+  headlessMemory.resize(headlessImageCount);
+
+  for(uint32_t i = 0; i < headlessImageCount; i++)
+  {
+    CHECK_VKR(vkCreateImage(device, vkh::ImageCreateInfo(width, height, 0, swapFormat,
+                                                         VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                                             VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                                             VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT),
+                            NULL, &swapImages[i]));
+
+    VkMemoryRequirements mrq;
+    vkGetImageMemoryRequirements(device, swapImages[i], &mrq);
+
+    // prefer device local memory, but take anything compatible
+    uint32_t memType = ~0U;
+    for(uint32_t m = 0; m < memProps.memoryTypeCount; m++)
+    {
+      if((mrq.memoryTypeBits & (1U << m)) == 0)
+        continue;
+
+      if(memType == ~0U)
+        memType = m;
+
+      if(memProps.memoryTypes[m].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+      {
+        memType = m;
+        break;
+      }
+    }
+
+    if(memType == ~0U)
+    {
+      TEST_ERROR("No memory type available for headless backbuffer");
+      return false;
+    }
+
+    CHECK_VKR(vkAllocateMemory(device, vkh::MemoryAllocateInfo(mrq.size, memType), NULL,
+                               &headlessMemory[i]));
+    CHECK_VKR(vkBindImageMemory(device, swapImages[i], headlessMemory[i], 0));
+  }
+
+  if(swapRenderPass == VK_NULL_HANDLE)
+  {
+    vkh::RenderPassCreator renderPassCreateInfo;
+
+    renderPassCreateInfo.attachments.push_back(
+        vkh::AttachmentDescription(swapFormat, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL));
+
+    renderPassCreateInfo.addSubpass({VkAttachmentReference({0, VK_IMAGE_LAYOUT_GENERAL})});
+
+    swapRenderPass = createRenderPass(renderPassCreateInfo);
+  }
+
+  swapImageViews.resize(swapImages.size());
+  for(size_t i = 0; i < swapImages.size(); i++)
+  {
+    CHECK_VKR(vkCreateImageView(
+        device, vkh::ImageViewCreateInfo(swapImages[i], VK_IMAGE_VIEW_TYPE_2D, swapFormat), NULL,
+        &swapImageViews[i]));
+  }
+  swapFramebuffers.resize(swapImages.size());
+  for(size_t i = 0; i < swapImageViews.size(); i++)
+    swapFramebuffers[i] = createFramebuffer(
+        vkh::FramebufferCreateInfo(swapRenderPass, {swapImageViews[i]}, scissor.extent));
+
+  // start on the last image so the first acquire wraps around to 0
+  swapIndex = headlessImageCount - 1;
+
+  return true;
+}
+
 void VulkanGraphicsTest::destroySwap()
 {
   vkDeviceWaitIdle(device);
@@ -832,20 +2176,39 @@ void VulkanGraphicsTest::destroySwap()
   for(size_t i = 0; i < swapImages.size(); i++)
     vkDestroyImageView(device, swapImageViews[i], NULL);
 
+  if(headless)
+  {
+    for(size_t i = 0; i < swapImages.size(); i++)
+    {
+      vkDestroyImage(device, swapImages[i], NULL);
+      vkFreeMemory(device, headlessMemory[i], NULL);
+    }
+
+    swapImages.clear();
+    headlessMemory.clear();
+    return;
+  }
+
   vkDestroySwapchainKHR(device, swap, NULL);
 }
 
 void VulkanGraphicsTest::acquireImage()
 {
-  VkResult vkr = vkAcquireNextImageKHR(device, swap, UINT64_MAX, renderStartSemaphore,
-                                       VK_NULL_HANDLE, &swapIndex);
+  if(headless)
+  {
+    swapIndex = (swapIndex + 1) % (uint32_t)swapImages.size();
+    return;
+  }
+
+  VkSemaphore sem = frames[frameSlot].renderStartSemaphore;
+
+  VkResult vkr = vkAcquireNextImageKHR(device, swap, UINT64_MAX, sem, VK_NULL_HANDLE, &swapIndex);
 
   if(vkr == VK_SUBOPTIMAL_KHR || vkr == VK_ERROR_OUT_OF_DATE_KHR)
   {
     resize();
 
-    vkr = vkAcquireNextImageKHR(device, swap, UINT64_MAX, renderStartSemaphore, VK_NULL_HANDLE,
-                                &swapIndex);
+    vkr = vkAcquireNextImageKHR(device, swap, UINT64_MAX, sem, VK_NULL_HANDLE, &swapIndex);
   }
 }
 
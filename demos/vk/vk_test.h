@@ -24,8 +24,12 @@
 
 #pragma once
 
+#include <deque>
 #include <functional>
+#include <map>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <vector>
 #include "../test_common.h"
 #include "vk_headers.h"
@@ -103,6 +107,22 @@ struct AllocatedImage
     }                                                                                \
   } while(0);
 
+// descriptor pools for a single set layout, each sized to hold a whole number of its sets. Pools
+// are filled in order and only ever reset all together.
+struct DescriptorPoolList
+{
+  std::vector<VkDescriptorPool> pools;
+  std::vector<uint32_t> capacity;
+
+  // the pool currently being allocated from, and how many sets it has handed out
+  size_t current = 0;
+  uint32_t used = 0;
+
+  // sets allocated since the last reset, and the most there have ever been
+  uint32_t allocated = 0;
+  uint32_t peak = 0;
+};
+
 struct VulkanGraphicsTest : public GraphicsTest
 {
   static const TestAPI API = TestAPI::Vulkan;
@@ -111,7 +131,7 @@ struct VulkanGraphicsTest : public GraphicsTest
   ~VulkanGraphicsTest();
 
   bool Init(int argc, char **argv);
-  bool IsSupported();
+  static bool IsSupported();
   GraphicsWindow *MakeWindow(int width, int height, const char *title);
   VkResult CreateSurface(GraphicsWindow *win, VkSurfaceKHR *outSurf);
 
@@ -119,13 +139,47 @@ struct VulkanGraphicsTest : public GraphicsTest
   VkImage StartUsingBackbuffer(VkCommandBuffer cmd, VkAccessFlags nextUse, VkImageLayout layout);
   void FinishUsingBackbuffer(VkCommandBuffer cmd, VkAccessFlags prevUse, VkImageLayout layout);
   void Submit(int index, int totalSubmits, const std::vector<VkCommandBuffer> &cmds,
-              const std::vector<VkCommandBuffer> &seccmds = {});
+              const std::vector<VkSemaphore> &waitSemaphores = {},
+              const std::vector<VkSemaphore> &signalSemaphores = {});
+  // submits to any queue, e.g. transferQueue or computeQueue. Semaphores are waited on at all
+  // stages.
+  void SubmitToQueue(VkQueue q, const std::vector<VkCommandBuffer> &cmds,
+                     const std::vector<VkSemaphore> &waitSemaphores = {},
+                     const std::vector<VkSemaphore> &signalSemaphores = {});
   void Present();
 
+  // copy the backbuffer at the end of this frame back to the CPU without waiting for it. The
+  // callback is run once the frame has completed on the GPU, normally in a later Present()
+  void readbackBackbuffer(ReadbackCallback callback);
+
   VkPipelineShaderStageCreateInfo CompileShaderModule(const std::string &source_text,
                                                       ShaderLang lang, ShaderStage stage,
                                                       const char *entry_point = "main");
-  VkCommandBuffer GetCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  std::vector<VkPipelineShaderStageCreateInfo> CompileShaderModules(
+      const std::vector<ShaderCompileJob> &jobs);
+  VkPipelineShaderStageCreateInfo CreateShaderStage(const std::vector<uint32_t> &spirv,
+                                                    ShaderStage stage, const char *entry_point);
+  // command buffers are only valid for queues in the given family, by default the graphics family.
+  // This can be called from any thread, each thread allocates from its own command pools.
+  VkCommandBuffer GetCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                   uint32_t queueFamily = ~0U);
+
+  // uploads go through a staging ring, so destinations can be in GPU_ONLY memory as long as they
+  // were created with TRANSFER_DST usage. Uploads are only queued, and are all submitted together
+  // with a single barrier by flushUploads() which must be called before the data is used.
+  void uploadBuffer(VkBuffer dst, VkDeviceSize offset, const void *data, size_t size);
+  template <typename T, size_t N>
+  void uploadBuffer(VkBuffer dst, const T (&data)[N])
+  {
+    uploadBuffer(dst, 0, data, sizeof(T) * N);
+  }
+  // copies tightly packed texel data into one subresource, leaving the image in finalLayout. The
+  // previous contents of the image are discarded.
+  void uploadImage(VkImage dst, VkImageLayout finalLayout, VkExtent3D extent, const void *data,
+                   size_t size,
+                   VkImageSubresourceLayers subresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                   VkOffset3D offset = {0, 0, 0});
+  void flushUploads();
 
   void setName(VkObjectType objType, uint64_t obj, const std::string &name);
   void pushMarker(VkCommandBuffer cmd, const std::string &name);
@@ -135,7 +189,12 @@ struct VulkanGraphicsTest : public GraphicsTest
   template <typename T>
   void setName(T obj, const std::string &name);
 
+  // allocates a set that lives as long as the test
   VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout setLayout);
+  // allocates a set that's only valid until this frame slot is reused, for sets written each frame
+  VkDescriptorSet allocateFrameDescriptorSet(VkDescriptorSetLayout setLayout);
+  VkDescriptorSet allocateFromPools(DescriptorPoolList &list, VkDescriptorSetLayout setLayout);
+  void resetPools(DescriptorPoolList &list);
   VkPipeline createGraphicsPipeline(const VkGraphicsPipelineCreateInfo *info);
   VkPipeline createComputePipeline(const VkComputePipelineCreateInfo *info);
   VkFramebuffer createFramebuffer(const VkFramebufferCreateInfo *info);
@@ -143,10 +202,28 @@ struct VulkanGraphicsTest : public GraphicsTest
   VkImageView createImageView(const VkImageViewCreateInfo *info);
   VkPipelineLayout createPipelineLayout(const VkPipelineLayoutCreateInfo *info);
   VkDescriptorSetLayout createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo *info);
+  VkSemaphore createSemaphore();
+
+  void resetTimestampQueries();
+  void readTimestamps(uint32_t slot);
+  void reportTimestamps();
+  VkSemaphore recordReadback(uint32_t slot);
+  void finishReadback(uint32_t slot);
+
+  bool createDevice();
+  std::string getDeviceKey();
+  bool adoptSharedDevice();
+  void shareDevice();
+  bool loadPipelineCache();
+  void savePipelineCache();
+
+  VkDeviceSize allocateStaging(VkDeviceSize size);
+  VkFence allocateFence();
 
   void resize();
   void onResize(std::function<void()> callback) { resizeCallbacks.push_back(callback); }
   bool createSwap();
+  bool createHeadlessImages();
   void destroySwap();
   void acquireImage();
 
@@ -161,51 +238,181 @@ struct VulkanGraphicsTest : public GraphicsTest
   std::vector<const char *> optInstExts;
   std::vector<const char *> optDevExts;
 
+  // request queues separate from the graphics queue before Init(). If the device has no suitable
+  // queue these are the graphics queue, so tests can use them unconditionally.
+  bool wantTransferQueue = false;
+  bool wantComputeQueue = false;
+
   // core objects
-  VkInstance instance;
-  VkPhysicalDevice phys;
-  VkDevice device;
-  uint32_t queueFamilyIndex;
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice phys = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queueFamilyIndex = ~0U;
   VkQueue queue;
+  uint32_t transferQueueFamilyIndex = ~0U;
+  VkQueue transferQueue = VK_NULL_HANDLE;
+  uint32_t computeQueueFamilyIndex = ~0U;
+  VkQueue computeQueue = VK_NULL_HANDLE;
+
+  // each distinct queue above, starting with the graphics queue
+  std::vector<VkQueue> queues;
 
   // swapchain stuff
   VkSurfaceKHR surface = VK_NULL_HANDLE;
   VkSwapchainKHR swap;
   VkFormat swapFormat;
+  // size of the backbuffer images, which tests can't change the way they can the scissor
+  VkExtent2D swapExtent = {};
   std::vector<VkImage> swapImages;
   std::vector<VkImageView> swapImageViews;
   uint32_t swapIndex = 0;
-  VkSemaphore renderStartSemaphore, renderEndSemaphore;
   std::vector<std::function<void()>> resizeCallbacks;
   VkRenderPass swapRenderPass;
   std::vector<VkFramebuffer> swapFramebuffers;
 
+  struct TimestampRegion
+  {
+    std::string name;
+    uint32_t begin, end;
+  };
+
+  struct TimestampStats
+  {
+    uint32_t count;
+    double total, min, max;
+  };
+
+  // with --gpu-timestamps each pushMarker/popMarker region is timed on the GPU, and the results
+  // are printed at exit or written as JSON with --gpu-timestamps-json <path>
+  bool gpuTimestamps = false;
+  std::string gpuTimestampsJson;
+  uint32_t maxTimestampQueries = 1024;
+  double timestampPeriod = 1.0;
+  uint64_t timestampMask = ~0ULL;
+  std::mutex timestampLock;
+  // open regions in each command buffer, as indices into the current frame's regions
+  std::map<VkCommandBuffer, std::vector<size_t>> openRegions;
+  // stats for each region name, in the order they were first seen
+  std::vector<std::string> timestampNames;
+  std::map<std::string, TimestampStats> timestampStats;
+
+  // a command pool whose buffers are handed out in order, and all recycled when it's reset
+  struct CommandPool
+  {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> buffers[VK_COMMAND_BUFFER_LEVEL_RANGE_SIZE];
+    size_t used[VK_COMMAND_BUFFER_LEVEL_RANGE_SIZE] = {};
+  };
+
+  // per-frame data for each frame that can be queued on the GPU at once. There is a fence for
+  // each of the queues, signalled when all of the frame's submits to that queue have completed,
+  // and they are waited on before the slot is reused. At that point the command pools are reset in
+  // one go and their command buffers handed out again. There is a command pool for each thread and
+  // queue family that has recorded commands.
+  struct FrameData
+  {
+    VkSemaphore renderStartSemaphore;
+    VkSemaphore renderEndSemaphore;
+    std::vector<VkFence> fences;
+    std::map<std::pair<std::thread::id, uint32_t>, CommandPool> cmdPools;
+    std::map<VkDescriptorSetLayout, DescriptorPoolList> descPools;
+
+    // marker regions timestamped this frame. The query pool is reset when the frame starts and
+    // read back once the slot is reused.
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    uint32_t queriesUsed = 0;
+    std::vector<TimestampRegion> regions;
+
+    // the backbuffer copied back this frame, delivered once the slot's fences have signalled
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VmaAllocation readbackAlloc = VK_NULL_HANDLE;
+    byte *readbackData = NULL;
+    VkDeviceSize readbackSize = 0;
+    VkSemaphore readbackSemaphore = VK_NULL_HANDLE;
+    VkExtent2D readbackExtent = {};
+    VkFormat readbackFormat = VK_FORMAT_UNDEFINED;
+    ReadbackCallback readbackCallback;
+  };
+
+  // protects cmdPools, not the pools themselves which are only used by one thread
+  std::mutex cmdPoolLock;
+
+  uint32_t framesInFlight = 1;
+  uint32_t frameSlot = 0;
+  std::vector<FrameData> frames;
+
+  // requested for the current frame, and whether the backbuffer can be copied from at all
+  ReadbackCallback pendingReadback;
+  bool backbufferReadable = false;
+
+  // staging memory for uploads. This is persistently mapped and used as a ring buffer, with each
+  // flush's range of the ring held until its fence has signalled.
+  struct StagingRange
+  {
+    VkFence fence;
+    VkDeviceSize begin, end;
+  };
+
+  struct StagedBufferCopy
+  {
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct StagedImageCopy
+  {
+    VkImage dst;
+    VkImageLayout finalLayout;
+    VkBufferImageCopy region;
+  };
+
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  VmaAllocation stagingAlloc = VK_NULL_HANDLE;
+  byte *stagingData = NULL;
+  VkDeviceSize stagingSize = 16 * 1024 * 1024;
+  VkDeviceSize stagingHead = 0, stagingFlushStart = 0;
+  std::deque<StagingRange> stagingInFlight;
+  std::vector<StagedBufferCopy> stagedBufferCopies;
+  std::vector<StagedImageCopy> stagedImageCopies;
+
+  // fences that have been reset and can be reused
+  std::vector<VkFence> freeFences;
+
+  // when running headless, swapImages are plain images cycled through in place of a swapchain
+  uint32_t headlessImageCount = 3;
+  std::vector<VkDeviceMemory> headlessMemory;
+
+  // identifies the requested instance and device setup, so a shared device is only reused by a
+  // test that would have created an identical one
+  std::string deviceKey;
+
   // utilities
-  VkDebugReportCallbackEXT debugReportCallback;
-  VkCommandPool cmdPool;
+  VkDebugReportCallbackEXT debugReportCallback = VK_NULL_HANDLE;
+
+  // pipeline cache persisted to disk between runs, unless disabled with --no-pipeline-cache
+  bool pipelineCacheEnabled = true;
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  std::string pipelineCachePath;
 
   // tracking object lifetimes
   std::vector<VkShaderModule> shaders;
-  std::vector<VkDescriptorPool> descPools;
+  std::map<VkDescriptorSetLayout, DescriptorPoolList> descPools;
   std::vector<VkPipeline> pipes;
   std::vector<VkFramebuffer> framebuffers;
   std::vector<VkRenderPass> renderpasses;
   std::vector<VkImageView> imageviews;
   std::vector<VkPipelineLayout> pipelayouts;
   std::vector<VkDescriptorSetLayout> setlayouts;
+  std::vector<VkSemaphore> semaphores;
+
+  // descriptors needed for one set of each layout, used to size its pools
+  std::map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> setLayoutSizes;
 
   VkViewport viewport;
   VkRect2D scissor;
 
   GraphicsWindow *mainWindow = NULL;
 
-  // internal bookkeeping
-  std::set<VkFence> fences;
-
-  std::vector<VkCommandBuffer> freeCommandBuffers[VK_COMMAND_BUFFER_LEVEL_RANGE_SIZE];
-  std::vector<std::pair<VkCommandBuffer, VkFence>>
-      pendingCommandBuffers[VK_COMMAND_BUFFER_LEVEL_RANGE_SIZE];
-
   // VMA
   VmaAllocator allocator = VK_NULL_HANDLE;
 };
\ No newline at end of file
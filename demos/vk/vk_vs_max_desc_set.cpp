@@ -118,11 +118,11 @@ void main()
 
     dynamic_func += "; }\n\n";
 
-    pipeCreateInfo.stages = {
-        CompileShaderModule(common + dynamic_decl + dynamic_func + vertex, ShaderLang::glsl,
-                            ShaderStage::vert, "main"),
-        CompileShaderModule(common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"),
-    };
+    pipeCreateInfo.stages = CompileShaderModules({
+        {common + dynamic_decl + dynamic_func + vertex, ShaderLang::glsl, ShaderStage::vert,
+         "main"},
+        {common + pixel, ShaderLang::glsl, ShaderStage::frag, "main"},
+    });
 
     VkPipeline pipe = createGraphicsPipeline(pipeCreateInfo);
 
@@ -147,16 +147,18 @@ void main()
 
     cb.upload(cbufferdata);
 
-    VkDescriptorSet descset = allocateDescriptorSet(setlayout);
-
-    vkh::updateDescriptorSets(
-        device, {
-                    vkh::WriteDescriptorSet(descset, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                            {vkh::DescriptorBufferInfo(cb.buffer)}),
-                });
-
     while(Running())
     {
+      // the set is rewritten every frame, so it comes from this frame slot's pools which are reset
+      // wholesale once the slot comes around again
+      VkDescriptorSet descset = allocateFrameDescriptorSet(setlayout);
+
+      vkh::updateDescriptorSets(
+          device, {
+                      vkh::WriteDescriptorSet(descset, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                              {vkh::DescriptorBufferInfo(cb.buffer)}),
+                  });
+
       VkCommandBuffer cmd = GetCommandBuffer();
 
       vkBeginCommandBuffer(cmd, vkh::CommandBufferBeginInfo());
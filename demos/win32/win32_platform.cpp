@@ -40,3 +40,92 @@ std::string GetCWD()
 
   return cwdstr;
 }
+
+std::string GetDefaultCacheDir()
+{
+  const char *appdata = getenv("LOCALAPPDATA");
+  if(appdata && appdata[0])
+    return std::string(appdata) + "/renderdoc_demos";
+
+  char temp[MAX_PATH + 1] = {0};
+  GetTempPathA(MAX_PATH, temp);
+
+  return std::string(temp) + "/renderdoc_demos";
+}
+
+bool MakeDir(const std::string &path)
+{
+  // create each parent in turn, ignoring any that already exist
+  for(size_t i = 1; i <= path.size(); i++)
+  {
+    if(i == path.size() || path[i] == '/' || path[i] == '\\')
+    {
+      std::string sub = path.substr(0, i);
+
+      // skip drive letters
+      if(sub.back() == ':')
+        continue;
+
+      if(!CreateDirectoryA(sub.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+std::string FindInPath(const std::string &exe)
+{
+  char path[MAX_PATH + 1] = {0};
+
+  DWORD len = SearchPathA(NULL, exe.c_str(), NULL, MAX_PATH, path, NULL);
+
+  if(len == 0 || len > MAX_PATH)
+    return "";
+
+  return path;
+}
+
+bool GetFileStamp(const std::string &path, uint64_t &size, uint64_t &modified)
+{
+  WIN32_FILE_ATTRIBUTE_DATA data = {};
+  if(!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+    return false;
+
+  size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+  modified = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) |
+             data.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+std::string GetModulePath(const void *address)
+{
+  HMODULE mod = NULL;
+  if(!GetModuleHandleExA(
+         GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+         (LPCSTR)address, &mod))
+    return "";
+
+  char path[MAX_PATH + 1] = {0};
+
+  DWORD len = GetModuleFileNameA(mod, path, MAX_PATH);
+
+  if(len == 0 || len >= MAX_PATH)
+    return "";
+
+  return path;
+}
+
+std::string MakeTempFile()
+{
+  char dir[MAX_PATH + 1] = {0};
+  char path[MAX_PATH + 1] = {0};
+
+  GetTempPathA(MAX_PATH, dir);
+
+  // with uUnique set to 0 this creates the file, guaranteeing the name is unique
+  if(GetTempFileNameA(dir, "rdc", 0, path) == 0)
+    return "";
+
+  return path;
+}
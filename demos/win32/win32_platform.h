@@ -27,6 +27,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define _CRT_NONSTDC_NO_DEPRECATE
 #define NOMINMAX
+#include <process.h>
 #include <windows.h>
 
 #define DEBUG_BREAK()       \
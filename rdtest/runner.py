@@ -5,8 +5,8 @@ import sys
 import re
 import platform
 import subprocess
-import threading
-import queue
+import asyncio
+import collections
 import time
 import renderdoc as rd
 from . import util
@@ -32,116 +32,247 @@ RUNNER_TIMEOUT = 30    # Require output every 30 seconds
 RUNNER_DEBUG = False   # Debug test runner running by printing messages to track it
 
 
-def _enqueue_output(process: subprocess.Popen, out, q: queue.Queue):
-    try:
-        for line in iter(out.readline, b''):
-            q.put(line)
+# Printed by a worker on stdout after each test, followed by 1 if it passed or 0 if it failed
+_WORKER_RESULT = '@@ rdtest worker result: '
 
-            if process.returncode is not None:
-                break
-    except Exception:
-        pass
 
+class _TestWorker:
+    """
+    A child process which stays running and runs tests one at a time as they are sent to it, so the
+    python startup, renderdoc import and test discovery are only paid once per worker. If a test
+    crashes or hangs only the worker is lost, and it's replaced.
+
+    The worker logs to its stdout, which is read on the runner's event loop and passed on to the log
+    as it arrives.
+    """
+
+    def __init__(self, process):
+        self.process = process
+        self.last_output = time.monotonic()
+        self.stderr_task = asyncio.ensure_future(self._read_stderr())
+
+    @staticmethod
+    async def start():
+        # Fork the interpreter with the same parameters, in worker mode
+        args = sys.argv.copy()
+        args.append('--internal_worker')
+
+        env = os.environ.copy()
+        env['PYTHONIOENCODING'] = 'utf-8'
+
+        process = await asyncio.create_subprocess_exec(sys.executable, *args, stdin=subprocess.PIPE,
+                                                       stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                                       env=env, limit=1024*1024)
+
+        return _TestWorker(process)
+
+    async def _read_stderr(self):
+        # stderr isn't logged, but counts as output for the timeout
+        while True:
+            line = await self.process.stderr.readline()
+
+            if not line:
+                return
 
-def _run_test(testclass, failedcases: list):
-    name = testclass.__name__
+            self.last_output = time.monotonic()
 
-    # Fork the interpreter to run the test, in case it crashes we can catch it.
-    # We can re-run with the same parameters
-    args = sys.argv.copy()
-    args.insert(0, sys.executable)
+            if RUNNER_DEBUG:
+                print("Test stderr: {}".format(line.decode('utf-8', errors='replace')))
 
-    # Add parameter to run the test itself
-    args.append('--internal_run_test')
-    args.append(name)
+    # Runs a test, passing each line it logs to output. Returns True if it passed and False if it
+    # failed. Raises if the worker crashed or stopped responding, in which case it's been killed.
+    async def run_test(self, name: str, output):
+        try:
+            self.process.stdin.write('{}\n'.format(name).encode('utf-8'))
+            await self.process.stdin.drain()
+        except (BrokenPipeError, ConnectionResetError):
+            pass  # The worker has already died, which is handled below when its stdout closes
 
-    test_run = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+        self.last_output = time.monotonic()
 
-    output_threads = []
+        while True:
+            try:
+                line = await asyncio.wait_for(self.process.stdout.readline(),
+                                              self.last_output + RUNNER_TIMEOUT - time.monotonic())
+            except asyncio.TimeoutError:
+                # Output on stderr may have kept the worker alive while we waited
+                if time.monotonic() < self.last_output + RUNNER_TIMEOUT:
+                    continue
+
+                await self.kill()
+                raise RuntimeError('Timed out, no output within {}s elapsed'.format(RUNNER_TIMEOUT))
+
+            # The worker's stdout closed before it reported a result, so it has died
+            if not line:
+                break
 
-    test_stdout = queue.Queue()
-    t = threading.Thread(target=_enqueue_output, args=(test_run, test_run.stdout, test_stdout))
-    t.daemon = True  # thread dies with the program
-    t.start()
+            self.last_output = time.monotonic()
 
-    output_threads.append(t)
+            line = line.decode('utf-8', errors='replace').replace('\r\n', '\n')
 
-    test_stderr = queue.Queue()
-    t = threading.Thread(target=_enqueue_output, args=(test_run, test_run.stderr, test_stderr))
-    t.daemon = True  # thread dies with the program
-    t.start()
+            if RUNNER_DEBUG:
+                print("Test stdout: {}".format(line))
 
-    output_threads.append(t)
+            if _WORKER_RESULT in line:
+                result = line.split(_WORKER_RESULT)
 
-    if RUNNER_DEBUG:
-        print("Waiting for test runner to complete...")
+                if result[0] != '':
+                    output(result[0] + '\n')
 
-    while test_run.poll() is None:
-        out = err = ""
+                return result[1].strip() == '1'
 
-        if RUNNER_DEBUG:
-            print("Checking runner output...")
+            output(line)
 
         try:
-            out = test_stdout.get(timeout=RUNNER_TIMEOUT)
-            while not test_stdout.empty():
-                out += test_stdout.get_nowait()
+            await asyncio.wait_for(self.process.wait(), 10)
+        except asyncio.TimeoutError:
+            await self.kill()
+            raise RuntimeError('INTERNAL ERROR: Couldn\'t get test return code')
+
+        await self.stderr_task
+
+        raise RuntimeError('Test did not exit cleanly while running, possible crash. Exit code {}'
+                           .format(self.process.returncode))
+
+    async def kill(self):
+        if self.process.returncode is None:
+            self.process.kill()
+
+        await self.process.wait()
+        await self.stderr_task
 
-                if test_run.poll() is not None:
-                    break
-        except queue.Empty:
-            out = None  # No output
+    async def shutdown(self):
+        # Closing stdin tells the worker there are no more tests
+        self.process.stdin.close()
 
         try:
-            while not test_stderr.empty():
-                err += test_stderr.get_nowait()
-
-                if test_run.poll() is not None:
-                    break
-        except queue.Empty:
-            err = None  # No output
-
-        if RUNNER_DEBUG and out is not None:
-            print("Test stdout: {}".format(out))
-
-        if RUNNER_DEBUG and err is not None:
-            print("Test stderr: {}".format(err))
-
-        if out is None and err is None and test_run.poll() is None:
-            log.error('Timed out, no output within {}s elapsed'.format(RUNNER_TIMEOUT))
-            test_run.kill()
-            test_run.communicate()
-            raise subprocess.TimeoutExpired(' '.join(args), RUNNER_TIMEOUT)
-
-    if RUNNER_DEBUG:
-        print("Test runner has finished")
-
-    # If we couldn't get the return code, something went wrong in the timeout above
-    # and the program never exited. Try once more to kill it then bail
-    if test_run.returncode is None:
-        test_run.kill()
-        test_run.communicate()
-        raise RuntimeError('INTERNAL ERROR: Couldn\'t get test return code')
-
-    for t in output_threads:
-        t.join(10)
-
-        if t.is_alive():
-            raise RuntimeError('INTERNAL ERROR: Subprocess output thread couldn\'t be closed')
-
-    # Return code of 0 means we exited cleanly, nothing to do
-    if test_run.returncode == 0:
-        pass
-    # Return code of 1 means the test failed, but we have already logged the exception
-    # so we just need to mark this test as failed
-    elif test_run.returncode == 1:
-        failedcases.append(testclass)
+            await asyncio.wait_for(self.process.wait(), 10)
+        except asyncio.TimeoutError:
+            pass
+
+        await self.kill()
+
+
+class _OrderedLog:
+    """
+    Writes each test's results to the log in test order, whatever order they finish in. The output of
+    the earliest unfinished test goes straight to the log, and later tests' output is held until it's
+    their turn.
+    """
+
+    def __init__(self, testcases: list, skip_reasons: dict):
+        self.testcases = testcases
+        self.skip_reasons = skip_reasons
+        self.index = 0
+        self.pending_output = {}
+        self.results = {}
+        self.failedcases = []
+        self.skippedcases = []
+
+        self._advance()
+
+    def output(self, testclass, line: str):
+        if self.index < len(self.testcases) and self.testcases[self.index] == testclass:
+            log.subprocess_print(line)
+        else:
+            self.pending_output.setdefault(testclass, []).append(line)
+
+    def finish(self, testclass, passed: bool, error: Exception = None):
+        self.results[testclass] = (passed, error)
+        self._advance()
+
+    def _advance(self):
+        while self.index < len(self.testcases):
+            testclass = self.testcases[self.index]
+            name = testclass.__name__
+
+            if testclass in self.skip_reasons:
+                log.print(self.skip_reasons[testclass])
+                self.skippedcases.append(testclass)
+                self.index += 1
+                continue
+
+            # Print header (and footer) outside the test so we know they will always be printed
+            if log.test_name != name:
+                log.begin_test(name)
+
+                for line in self.pending_output.pop(testclass, []):
+                    log.subprocess_print(line)
+
+            if testclass not in self.results:
+                return
+
+            passed, error = self.results.pop(testclass)
+
+            if error is not None:
+                # Re-raise so that the failure is logged with its callstack
+                try:
+                    raise error
+                except Exception as ex:
+                    log.failure(ex)
+
+            if not passed:
+                self.failedcases.append(testclass)
+
+            log.end_test(name)
+
+            self.index += 1
+
+
+async def _run_tests_in_workers(testcases: list, jobs: int, results: _OrderedLog):
+    pending = collections.deque(testcases)
+
+    async def run_worker():
+        # Start the worker before taking a test, so all workers initialise at the same time
+        worker = await _TestWorker.start()
+
+        while len(pending) > 0:
+            testclass = pending.popleft()
+
+            try:
+                passed = await worker.run_test(testclass.__name__,
+                                               lambda line: results.output(testclass, line))
+            except Exception as ex:
+                results.finish(testclass, False, ex)
+                await worker.kill()
+                worker = await _TestWorker.start()
+                continue
+
+            results.finish(testclass, passed)
+
+            # A failed test may have left renderdoc in a bad state, e.g. a replay that was never shut
+            # down, so don't risk it affecting the next test
+            if not passed:
+                await worker.shutdown()
+                worker = await _TestWorker.start()
+
+        await worker.shutdown()
+
+    await asyncio.gather(*[run_worker() for i in range(min(jobs, len(testcases)))])
+
+
+def _run_event_loop(coro):
+    # Subprocesses on windows need the proactor loop, which isn't the default before python 3.8
+    if sys.platform == 'win32':
+        loop = asyncio.ProactorEventLoop()
     else:
-        raise RuntimeError('Test did not exit cleanly while running, possible crash. Exit code {}'
-                           .format(test_run.returncode))
+        loop = asyncio.new_event_loop()
+
+    # Before python 3.8 subprocesses only work on the current loop, and on POSIX the child watcher
+    # has to be attached to it to see children exit. Later versions use a watcher thread instead.
+    asyncio.set_event_loop(loop)
+
+    if sys.platform != 'win32' and sys.version_info < (3, 8):
+        asyncio.get_child_watcher().attach_loop(loop)
+
+    try:
+        loop.run_until_complete(coro)
+    finally:
+        asyncio.set_event_loop(None)
+        loop.close()
 
 
-def run_tests(test_include: str, test_exclude: str, in_process: bool, slow_tests: bool):
+def run_tests(test_include: str, test_exclude: str, in_process: bool, slow_tests: bool, jobs: int = 1):
     start_time = time.time()
 
     rd.InitGlobalEnv(rd.GlobalEnvironment(), [])
@@ -234,9 +365,6 @@ def run_tests(test_include: str, test_exclude: str, in_process: bool, slow_tests
     else:
         log.print("Running tests matching '{}'".format(test_include))
 
-    failedcases = []
-    skippedcases = []
-
     ver = 0
 
     if plat == 'win32':
@@ -247,46 +375,45 @@ def run_tests(test_include: str, test_exclude: str, in_process: bool, slow_tests
         except AttributeError:
             pass
 
+    # Decide up front which tests to skip, so that in parallel the tests to run can all be started
+    # before any results are logged
+    skip_reasons = {}
+
     for testclass in testcases:
         name = testclass.__name__
 
         if ((testclass.platform != '' and testclass.platform != plat) or
                 (testclass.platform_version != 0 and testclass.platform_version > ver)):
-            log.print("Skipping {} as it's not supported on this platform '{} version {}'".format(name, plat, ver))
-            skippedcases.append(testclass)
-            continue
+            skip_reasons[testclass] = "Skipping {} as it's not supported on this platform '{} version {}'".format(name, plat, ver)
+        elif not include_regexp.search(name):
+            skip_reasons[testclass] = "Skipping {} as it doesn't match '{}'".format(name, test_include)
+        elif exclude_regexp is not None and exclude_regexp.search(name):
+            skip_reasons[testclass] = "Skipping {} as it matches '{}'".format(name, test_exclude)
+        elif not slow_tests and testclass.slow_test:
+            skip_reasons[testclass] = "Skipping {} as it is a slow test, which are not enabled".format(name)
 
-        if not include_regexp.search(name):
-            log.print("Skipping {} as it doesn't match '{}'".format(name, test_include))
-            skippedcases.append(testclass)
-            continue
+    if jobs > 1:
+        log.print("Running tests with {} parallel jobs".format(jobs))
 
-        if exclude_regexp is not None and exclude_regexp.search(name):
-            log.print("Skipping {} as it matches '{}'".format(name, test_exclude))
-            skippedcases.append(testclass)
-            continue
+    results = _OrderedLog(testcases, skip_reasons)
 
-        if not slow_tests and testclass.slow_test:
-            log.print("Skipping {} as it is a slow test, which are not enabled".format(name))
-            skippedcases.append(testclass)
-            continue
+    torun = [testclass for testclass in testcases if testclass not in skip_reasons]
 
-        # Print header (and footer) outside the exec so we know they will always be printed successfully
-        log.begin_test(name)
+    if in_process:
+        for testclass in torun:
+            util.set_current_test(testclass.__name__)
 
-        util.set_current_test(name)
-
-        try:
-            if in_process:
+            try:
                 instance = testclass()
                 instance.invoketest()
-            else:
-                _run_test(testclass, failedcases)
-        except Exception as ex:
-            log.failure(ex)
-            failedcases.append(testclass)
+                results.finish(testclass, True)
+            except Exception as ex:
+                results.finish(testclass, False, ex)
+    else:
+        _run_event_loop(_run_tests_in_workers(torun, jobs, results))
 
-        log.end_test(name)
+    failedcases = results.failedcases
+    skippedcases = results.skippedcases
 
     duration = time.time() - start_time
 
@@ -315,32 +442,38 @@ def vulkan_register():
     rd.UpdateVulkanLayerRegistration(True)
 
 
-def internal_run_test(test_name):
-    testcases = get_tests()
+def _internal_run_test(testclass, test_name):
+    log.begin_test(test_name, print_header=False)
 
-    rd.InitGlobalEnv(rd.GlobalEnvironment(), [])
+    util.set_current_test(test_name)
 
-    log.add_output(util.get_artifact_path("output.log.html"))
+    try:
+        if testclass is None:
+            raise RuntimeError("INTERNAL ERROR: Couldn't find '{}' test to run".format(test_name))
 
-    for testclass in testcases:
-        if testclass.__name__ == test_name:
-            log.begin_test(test_name, print_header=False)
+        instance = testclass()
+        instance.invoketest()
+        suceeded = True
+    except Exception as ex:
+        log.failure(ex)
+        suceeded = False
 
-            util.set_current_test(test_name)
+    log.end_test(test_name, print_footer=False)
 
-            try:
-                instance = testclass()
-                instance.invoketest()
-                suceeded = True
-            except Exception as ex:
-                log.failure(ex)
-                suceeded = False
+    return suceeded
 
-            log.end_test(test_name, print_footer=False)
 
-            if suceeded:
-                sys.exit(0)
-            else:
-                sys.exit(1)
+def internal_worker():
+    testcases = {t.__name__: t for t in get_tests()}
+
+    rd.InitGlobalEnv(rd.GlobalEnvironment(), [])
+
+    # Each line is the name of a test to run, and everything logged goes to stdout for the runner to
+    # pass on. The runner closes our stdin when there are no more tests
+    for line in sys.stdin:
+        test_name = line.strip()
+
+        suceeded = _internal_run_test(testcases.get(test_name), test_name)
 
-    log.error("INTERNAL ERROR: Couldn't find '{}' test to run".format(test_name))
+        sys.stdout.write('{}{}\n'.format(_WORKER_RESULT, 1 if suceeded else 0))
+        sys.stdout.flush()
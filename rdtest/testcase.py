@@ -243,10 +243,81 @@ class TestCase:
 
         return last_draw
 
-    def check_final_backbuffer(self):
-        img_path = util.get_tmp_path('backbuffer.png')
-        ref_path = self.get_ref_path('backbuffer.png')
+    def _read_texture_image(self, save_data: rd.TextureSave):
+        """
+        Reads a texture back as an image, for textures which SaveTexture would write out unchanged as a
+        PNG. Returns None for anything that needs converting or remapping.
+        """
+        default_save = rd.TextureSave()
+
+        if (save_data.channelExtract != default_save.channelExtract or save_data.alpha != default_save.alpha or
+                save_data.comp.blackPoint != default_save.comp.blackPoint or
+                save_data.comp.whitePoint != default_save.comp.whitePoint):
+            return None
+
+        tex: rd.TextureDescription = None
+        for t in self.controller.GetTextures():
+            if t.resourceId == save_data.resourceId:
+                tex = t
+                break
+
+        # Debug overlays and other replay-only textures aren't listed. An overlay also isn't stored in the
+        # displayed texture's format but in whatever the replay renders overlays to, which SaveTexture knows
+        # how to convert, so these go through SaveTexture as well
+        if tex is None:
+            return None
+
+        # GL stores rows bottom-up, so leave the orientation to SaveTexture rather than second-guessing it
+        if self.controller.GetAPIProperties().pipelineType == rd.GraphicsAPI.OpenGL:
+            return None
+
+        fmt: rd.ResourceFormat = tex.format
+        if (fmt.type != rd.ResourceFormatType.Regular or fmt.compType != rd.CompType.UNorm or
+                fmt.compCount != 4 or fmt.compByteWidth != 1 or tex.msSamp > 1 or tex.depth > 1):
+            return None
+
+        mip = max(save_data.mip, 0)
+        width = max(tex.width >> mip, 1)
+        height = max(tex.height >> mip, 1)
+
+        data: bytes = self.controller.GetTextureData(tex.resourceId, max(save_data.slice.sliceIndex, 0), mip)
+
+        if len(data) != width * height * 4:
+            return None
+
+        return util.image_from_texels(width, height, data, fmt.bgraOrder)
 
+    def check_texture(self, save_data: rd.TextureSave, ref_name: str, message: str, tolerance: int = 2):
+        """
+        Compares a texture against a reference image, raising a TestFailureException with message if they
+        differ. Plain 8-bit textures are compared in memory without being saved, and the output image is
+        only written to the temp folder on a failure, to go into the artifacts. Anything else, including
+        debug overlays from GetDebugOverlayTexID(), is saved with SaveTexture and compared from the file.
+
+        :param save_data: The texture to compare, and any remapping to apply as when saving it.
+        :param ref_name: The name of the reference image, also used for the output image.
+        :param message: The failure message.
+        :param tolerance: The amount each channel may differ by.
+        """
+        img_path = util.get_tmp_path(ref_name)
+        ref_path = self.get_ref_path(ref_name)
+
+        out = self._read_texture_image(save_data)
+
+        if out is not None:
+            result = util.compare_images(out, util.get_reference_image(ref_path), tolerance)
+
+            if not result:
+                out.save(img_path)
+        else:
+            self.controller.SaveTexture(save_data, img_path)
+
+            result = util.image_compare(img_path, ref_path, tolerance)
+
+        if not result:
+            raise TestFailureException("{}: {}".format(message, result), ref_path, img_path)
+
+    def check_final_backbuffer(self):
         last_draw: rd.DrawcallDescription = self.get_last_draw()
 
         self.controller.SetFrameEvent(last_draw.eventId, True)
@@ -255,10 +326,7 @@ class TestCase:
         save_data.resourceId = last_draw.copyDestination
         save_data.destType = rd.FileType.PNG
 
-        self.controller.SaveTexture(save_data, img_path)
-
-        if not util.image_compare(img_path, ref_path):
-            raise TestFailureException("Reference and output backbuffer image differ", ref_path, img_path)
+        self.check_texture(save_data, 'backbuffer.png', "Reference and output backbuffer image differ")
 
         log.success("Backbuffer is identical to reference")
 
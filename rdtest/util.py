@@ -4,7 +4,13 @@ import re
 import time
 import hashlib
 import zipfile
-from PIL import Image, ImageChops, ImageStat
+from PIL import Image, ImageChops
+
+# numpy is optional, but makes image comparisons much faster
+try:
+    import numpy
+except ImportError:
+    numpy = None
 
 
 def _timestr():
@@ -90,9 +96,16 @@ def get_tmp_dir():
     return _temp_dir
 
 
+# Each test gets its own folder under the temp dir, so tests running in parallel processes never
+# share files
+def get_test_tmp_dir(test_name: str):
+    path = os.path.join(_temp_dir, test_name)
+    os.makedirs(path, exist_ok=True)
+    return path
+
+
 def get_tmp_path(name: str):
-    os.makedirs(os.path.join(_temp_dir, _test_name), exist_ok=True)
-    return os.path.join(_temp_dir, _test_name, name)
+    return os.path.join(get_test_tmp_dir(_test_name), name)
 
 
 def sanitise_filename(name: str):
@@ -104,42 +117,170 @@ def sanitise_filename(name: str):
     return re.sub('^/', '', name)
 
 
-def image_compare(test_img: str, ref_img: str, tolerance: int = 2):
-    try:
-        out = Image.open(test_img)
-    except Exception as ex:
-        raise FileNotFoundError("Can't open {}".format(sanitise_filename(test_img)))
+class ImageCompareResult:
+    """
+    The result of an image comparison. This is truthy if the images matched, so it can be used as a bool,
+    and otherwise describes how they differ.
+    """
 
-    try:
-        ref = Image.open(ref_img)
-    except Exception as ex:
-        raise FileNotFoundError("Can't open {}".format(sanitise_filename(ref_img)))
+    def __init__(self, matched: bool, message: str = '', max_error: int = 0, failing_pixels: int = 0,
+                 bounds: tuple = None):
+        self.matched = matched
+        self.message = message
+        # The largest per-channel difference between the images
+        self.max_error = max_error
+        # The number of pixels with any channel differing by more than the tolerance
+        self.failing_pixels = failing_pixels
+        # The (left, top, right, bottom) box around the failing pixels, exclusive at the bottom right
+        self.bounds = bounds
+
+    def __bool__(self):
+        return self.matched
+
+    def __str__(self):
+        if self.matched:
+            return 'images match'
+        if self.message != '':
+            return self.message
+        return '{} pixels differ, by up to {}, within {}'.format(self.failing_pixels, self.max_error, self.bounds)
+
+
+# Rows compared at once, so that matching images (the common case) are checked without computing a
+# difference for the whole image, and mismatches are found without looking at the rest
+_COMPARE_TILE_ROWS = 64
+
+
+def _image_array(img: Image):
+    # Going through the raw bytes is quicker than numpy.asarray(img)
+    return numpy.frombuffer(img.tobytes(), dtype=numpy.uint8).reshape(img.height, img.width, -1)
+
+
+def _abs_diff(a, b):
+    # The absolute difference of unsigned values, without widening them to a signed type
+    diff = numpy.maximum(a, b)
+    diff -= numpy.minimum(a, b)
+    return diff
+
+
+def _image_compare_numpy(out: Image, ref: Image, tolerance: int, diff_file: str):
+    out_data = _image_array(out)
+    ref_data = _image_array(ref)
+
+    for y in range(0, out_data.shape[0], _COMPARE_TILE_ROWS):
+        if _abs_diff(out_data[y:y+_COMPARE_TILE_ROWS], ref_data[y:y+_COMPARE_TILE_ROWS]).max() > tolerance:
+            break
+    else:
+        return ImageCompareResult(True)
+
+    diff = _abs_diff(out_data, ref_data)
+
+    # A pixel fails if any of its channels is over the tolerance
+    over = numpy.any(diff > tolerance, axis=2)
+
+    rows = numpy.flatnonzero(numpy.any(over, axis=1))
+    cols = numpy.flatnonzero(numpy.any(over, axis=0))
+
+    # Subtract the tolerance and scale up by 4 to make the differences visible
+    vis = numpy.clip((diff.astype(numpy.int16) - tolerance) * 4, 0, 255).astype(numpy.uint8)
+    if vis.shape[2] == 1:
+        vis = vis[:, :, 0]
+    Image.fromarray(vis).convert("RGB").save(diff_file)
+
+    return ImageCompareResult(False, max_error=int(diff.max()), failing_pixels=int(numpy.count_nonzero(over)),
+                              bounds=(int(cols[0]), int(rows[0]), int(cols[-1]) + 1, int(rows[-1]) + 1))
 
-    if out.mode != ref.mode or out.size != ref.size:
-        return False
 
+def _image_compare_pil(out: Image, ref: Image, tolerance: int, diff_file: str):
     # Generate the difference
     diff = ImageChops.difference(out, ref)
 
     # Subtract N from the difference, to allow for off-by-N errors that can be caused by rounding.
     # For example clearing to 0.5, 0.5, 0.5 has two valid representations: 127,127,127 and 128,128,128
     # which are equally far from true 0.5.
-    diff = ImageChops.subtract(diff, Image.new(diff.mode, (diff.width, diff.height),
-                                               (tolerance, tolerance, tolerance, tolerance)))
+    bands = len(diff.getbands())
+    diff = ImageChops.subtract(diff, Image.new(diff.mode, diff.size,
+                                               tolerance if bands == 1 else (tolerance,) * bands))
 
-    # If the diff fails, dump the difference to a file
+    # Combine the channels, so any channel over the tolerance marks the pixel as failing
+    over = diff.split()
+    mask = over[0]
+    for band in over[1:]:
+        mask = ImageChops.lighter(mask, band)
+
+    bounds = mask.getbbox()
+
+    if bounds is None:
+        return ImageCompareResult(True)
+
+    hist = mask.histogram()
+    max_over = max(i for i in range(len(hist)) if hist[i] > 0)
+
+    # this does (img1 + img2) / scale, so scale=0.5 means we multiply the image by 2/0.5 = 4
+    diff = ImageChops.add(diff, diff, scale=0.5)
+    diff.convert("RGB").save(diff_file)
+
+    return ImageCompareResult(False, max_error=max_over + tolerance, failing_pixels=mask.width * mask.height - hist[0],
+                              bounds=bounds)
+
+
+# Reference images never change during a run, so each is only decoded once
+_reference_images = {}
+
+
+def get_reference_image(ref_img: str):
+    if ref_img not in _reference_images:
+        try:
+            ref = Image.open(ref_img)
+            ref.load()
+        except Exception as ex:
+            raise FileNotFoundError("Can't open {}".format(sanitise_filename(ref_img)))
+
+        _reference_images[ref_img] = ref
+
+    return _reference_images[ref_img]
+
+
+def image_from_texels(width: int, height: int, data: bytes, bgra: bool = False):
+    """
+    Wraps tightly packed 8-bit RGBA (or BGRA) texel data as an RGBA image, without going through a file.
+    """
+    return Image.frombytes('RGBA', (width, height), data, 'raw', 'BGRA' if bgra else 'RGBA')
+
+
+def image_compare(test_img: str, ref_img: str, tolerance: int = 2):
+    """
+    Compares two image files, allowing each channel to be off by up to tolerance. On a mismatch the
+    differences are written to diff.png in the test's temp folder, to be included in the failure.
+
+    :return: An ImageCompareResult, which is truthy if the images matched.
+    """
+    try:
+        out = Image.open(test_img)
+    except Exception as ex:
+        raise FileNotFoundError("Can't open {}".format(sanitise_filename(test_img)))
+
+    return compare_images(out, get_reference_image(ref_img), tolerance)
+
+
+def compare_images(out: Image, ref: Image, tolerance: int = 2):
+    """
+    As image_compare, but for images that are already loaded.
+    """
     diff_file = get_tmp_path('diff.png')
 
-    if os.path.exists(diff_file):
-        os.remove(diff_file)
+    if out.mode != ref.mode or out.size != ref.size:
+        result = ImageCompareResult(False, '{} {} image doesn\'t match {} {} reference'
+                                    .format(out.mode, out.size, ref.mode, ref.size))
+    elif numpy is not None and out.mode in ['L', 'LA', 'RGB', 'RGBA']:
+        result = _image_compare_numpy(out, ref, tolerance, diff_file)
+    else:
+        result = _image_compare_pil(out, ref, tolerance, diff_file)
 
-    if sum(ImageStat.Stat(diff).sum) > 0:
-        # this does (img1 + img2) / scale, so scale=0.5 means we multiply the image by 2/0.5 = 4
-        diff = ImageChops.add(diff, diff, scale=0.5)
-        diff.convert("RGB").save(diff_file)
-        return False
+    # Don't leave a diff from an earlier comparison for a failure that didn't write one
+    if not result and result.message != '' and os.path.exists(diff_file):
+        os.remove(diff_file)
 
-    return True
+    return result
 
 
 def md5_compare(test_file: str, ref_file: str):
@@ -24,6 +24,8 @@ parser.add_argument('-x', '--test_exclude', default="",
                     help="The tests to exclude, as a regexp filter", type=str)
 parser.add_argument('--in-process',
                     help="Lists the tests available to run", action="store_true")
+parser.add_argument('-j', '--jobs', default=1,
+                    help="The number of tests to run in parallel, each in its own process", type=int)
 parser.add_argument('--slow-tests',
                     help="Run potentially slow tests", action="store_true")
 parser.add_argument('--data', default="data",
@@ -35,12 +37,18 @@ parser.add_argument('--artifacts', default="artifacts",
                     help="The folder to put output artifacts in. Will be completely cleared.", type=str)
 parser.add_argument('--temp', default="tmp",
                     help="The folder to put temporary run data in. Will be completely cleared.", type=str)
-# Internal command, when we fork out to run a test in a separate process
-parser.add_argument('--internal_run_test', help=argparse.SUPPRESS, type=str, required=False)
+# Internal command, when we fork out a worker process to run tests in
+parser.add_argument('--internal_worker', help=argparse.SUPPRESS, action="store_true", required=False)
 # Internal command, when we re-run as admin to register vulkan layer
 parser.add_argument('--internal_vulkan_register', help=argparse.SUPPRESS, action="store_true", required=False)
 args = parser.parse_args()
 
+if args.jobs < 1:
+    parser.error("--jobs must be at least 1")
+
+if args.in_process and args.jobs > 1:
+    parser.error("--in-process can't be combined with running tests in parallel")
+
 if args.renderdoc is not None:
     if os.path.isfile(args.renderdoc):
         os.environ["PATH"] += os.pathsep + os.path.abspath(os.path.dirname(args.renderdoc))
@@ -99,7 +107,7 @@ rdtest.set_temp_dir(os.path.realpath(args.temp))
 
 if args.internal_vulkan_register:
     rdtest.vulkan_register()
-elif args.internal_run_test is not None:
-    rdtest.internal_run_test(args.internal_run_test)
+elif args.internal_worker:
+    rdtest.internal_worker()
 else:
-    rdtest.run_tests(args.test_include, args.test_exclude, args.in_process, args.slow_tests)
+    rdtest.run_tests(args.test_include, args.test_exclude, args.in_process, args.slow_tests, args.jobs)
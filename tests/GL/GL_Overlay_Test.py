@@ -39,9 +39,6 @@ class GL_Overlay_Test(rdtest.TestCase):
             tex.overlay = overlay
             out.SetTextureDisplay(tex)
 
-            overlay_path = rdtest.get_tmp_path(str(overlay) + '.png')
-            ref_path = self.get_ref_path(str(overlay) + '.png')
-
             save_data = rd.TextureSave()
             save_data.resourceId = out.GetDebugOverlayTexID()
             save_data.destType = rd.FileType.PNG
@@ -60,10 +57,8 @@ class GL_Overlay_Test(rdtest.TestCase):
             if overlay == rd.DebugOverlay.ClearBeforeDraw or overlay == rd.DebugOverlay.ClearBeforePass:
                 save_data.resourceId = tex.resourceId
 
-            self.controller.SaveTexture(save_data, overlay_path)
-
-            if not rdtest.image_compare(overlay_path, ref_path, tolerance):
-                raise rdtest.TestFailureException("Reference and output image differ for overlay {}".format(str(overlay)), overlay_path, ref_path)
+            self.check_texture(save_data, str(overlay) + '.png',
+                               "Reference and output image differ for overlay {}".format(str(overlay)), tolerance)
 
             rdtest.log.success("Reference and output image are identical for {}".format(str(overlay)))
 
@@ -72,25 +67,13 @@ class GL_Overlay_Test(rdtest.TestCase):
         save_data.destType = rd.FileType.PNG
         save_data.channelExtract = 0
 
-        tmp_path = rdtest.get_tmp_path('depth.png')
-        ref_path = self.get_ref_path('depth.png')
-
-        self.controller.SaveTexture(save_data, tmp_path)
-
-        if not rdtest.image_compare(tmp_path, ref_path):
-            raise rdtest.TestFailureException("Reference and output image differ for depth {}", tmp_path, ref_path)
+        self.check_texture(save_data, 'depth.png', "Reference and output image differ for depth")
 
         rdtest.log.success("Reference and output image are identical for depth")
 
         save_data.channelExtract = 1
 
-        tmp_path = rdtest.get_tmp_path('stencil.png')
-        ref_path = self.get_ref_path('stencil.png')
-
-        self.controller.SaveTexture(save_data, tmp_path)
-
-        if not rdtest.image_compare(tmp_path, ref_path):
-            raise rdtest.TestFailureException("Reference and output image differ for stencil {}", tmp_path, ref_path)
+        self.check_texture(save_data, 'stencil.png', "Reference and output image differ for stencil")
 
         rdtest.log.success("Reference and output image are identical for stencil")
 
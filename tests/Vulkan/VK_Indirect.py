@@ -15,16 +15,10 @@ class VK_Indirect(rdtest.TestCase):
 
         out.SetTextureDisplay(tex)
 
-        overlay_path = rdtest.get_tmp_path(str(eventId) + '_draw.png')
-        ref_path = self.get_ref_path(str(eventId) + '_draw.png')
-
         save_data.resourceId = out.GetDebugOverlayTexID()
 
-        self.controller.SaveTexture(save_data, overlay_path)
-
-        if not rdtest.image_compare(overlay_path, ref_path):
-            raise rdtest.TestFailureException("Reference and output image differ @ EID {}".format(str(eventId)),
-                                              ref_path, overlay_path)
+        self.check_texture(save_data, str(eventId) + '_draw.png',
+                           "Reference and output image differ @ EID {}".format(str(eventId)))
 
     def check_capture(self):
         self.check_final_backbuffer()